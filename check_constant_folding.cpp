@@ -0,0 +1,156 @@
+#include "constant_folding.hpp"
+#include "main_parser.hpp"
+
+// Parses every expression as the only statement of a function, folds it and compares the result with
+// the expected one. Folded integers also have to be as wide as the lexer makes literals of the same value.
+
+struct FoldCase{
+	const char *expression;
+	const char *folded; // printed result, nullptr when the expression is not folded
+};
+
+constexpr FoldCase FoldCases[] = {
+	{"1 + 2", "3"},
+	{"-(8)", "-8"},
+	{"-(-8)", "8"},
+	{"~(7)", "-8"},
+	{"-7 % 2", "-1"},
+	{"7 /% 2", "{3, 1}"},
+	{"7 / 0", nullptr},
+	{"9223372036854775807 + 1", nullptr},
+	{"9223372036854775807 +% 1", "{-9223372036854775808, 1u}"},
+	{"-9223372036854775807 - 1", "-9223372036854775808"},
+	{"3 *% -5", "{18446744073709551601u, -1}"},
+	{"1 << 62", "4611686018427387904"},
+	{"1 << 63", nullptr},
+	{"-8 >> 1", "-4"},
+	{"1 < 2", "1u"},
+	{"1 == 1u", nullptr},
+
+	// without a suffix, literals from 2^63 up have no signed value
+	{"9223372036854775808 + 1", nullptr},
+	{"18446744073709551615 / 2", nullptr},
+	{"9223372036854775808 > 0", nullptr},
+	{"-(18446744073709551615)", nullptr},
+	{"~(9223372036854775808)", nullptr},
+	{"!(9223372036854775808)", nullptr},
+	{"9223372036854775808 >> 1", nullptr},
+	{"f64->(9223372036854775808)", nullptr},
+
+	{"18446744073709551615u / 2u", "9223372036854775807u"},
+	{"0u - 1u", "18446744073709551615u"},
+	{"18446744073709551615u +% 1u", "{0u, 1u}"},
+	{"9223372036854775808u >> 1u", "4611686018427387904u"},
+	{"u8->(-1)", "255u"},
+	{"i8->(300)", "44"},
+	{"i32->(2.9)", "2"},
+	{"u8->(256.0)", nullptr},
+	{"f64->(-3)", "-3"},
+	{"1.5 + 2.25", "3.75"},
+	{"'a' < 'b'", "1u"},
+};
+
+
+
+struct FoldOutput{
+	char text[256];
+	size_t size;
+	bool complete; // every node was printed
+};
+
+void append(FoldOutput &output, const char *format, auto... values) noexcept{
+	size_t capacity = sizeof(output.text) - output.size;
+	int count = snprintf(output.text+output.size, capacity, format, values...);
+	if (count > 0) output.size += (size_t)count<capacity ? count : capacity-1;
+}
+
+// integer literals of the lexer hold the number of bits of their magnitude in u16
+bool has_lexer_width(const Node &node) noexcept{
+	uint64_t magnitude = node.type==NodeType::Integer && (int64_t)node.data.u64<0 ? -node.data.u64 : node.data.u64;
+	return node.u16 == std::bit_width(magnitude);
+}
+
+void print_literal(FoldOutput &output, const Node &node) noexcept{
+	switch (node.type){
+	case NodeType::Integer:
+		append(output, "%lld", (long long)node.data.u64);
+		if (!has_lexer_width(node)) append(output, "(%u bits)", node.u16);
+		break;
+	case NodeType::Unsigned:
+		append(output, "%lluu", (unsigned long long)node.data.u64);
+		if (!has_lexer_width(node)) append(output, "(%u bits)", node.u16);
+		break;
+	case NodeType::Float:
+		append(output, "%.9gf", node.data.f32);
+		break;
+	case NodeType::Double:
+		append(output, "%.17g", node.data.f64);
+		break;
+	default:
+		output.complete = false;
+	}
+}
+
+// a folded statement is a literal, or an array literal of the two results of an operator
+FoldOutput print_statement(const Node *nodes, size_t size) noexcept{
+	FoldOutput output{{}, 0, true};
+	if (size==3 && nodes[0].type==NodeType::ArrayLiteral && nodes[0].data.size==2){
+		append(output, "{");
+		print_literal(output, nodes[1]);
+		append(output, ", ");
+		print_literal(output, nodes[2]);
+		append(output, "}");
+	} else if (size == 1){
+		print_literal(output, nodes[0]);
+	} else{
+		output.complete = false;
+	}
+	return output;
+}
+
+bool check_case(const FoldCase &fold_case) noexcept{
+	char text[256];
+	snprintf(text, sizeof(text), "(){\n\t%s;\n}\n", fold_case.expression);
+	code_text = text;
+
+	Diagnostic diagnostic_buffer[4];
+	DiagnosticSink sink{diagnostic_buffer, (uint32_t)sp::len(diagnostic_buffer)};
+	diagnostics = &sink;
+	sp::DynamicArray<Node, sp::MallocAllocator<>> tokens = make_tokens(text);
+	NodeArrayType nodes;
+	LabelArrayType labels;
+	const Node *token_iter = sp::beg(tokens);
+	uint32_t body = parse_function(nodes, labels, &token_iter);
+	diagnostics = nullptr;
+
+	bool same;
+	if (sink.count){
+		printf("%s: cannot be parsed\n", fold_case.expression);
+		same = false;
+	} else{
+		fold_constants(nodes, body);
+		FoldOutput output = print_statement(sp::beg(nodes)+body, sp::len(nodes)-body-1); // without terminator
+		if (!fold_case.folded){
+			same = !output.complete;
+			if (!same) printf("%s: folded to %s, it should not be folded\n", fold_case.expression, output.text);
+		} else{
+			same = output.complete && !strcmp(output.text, fold_case.folded);
+			if (!same && output.complete)
+				printf("%s: folded to %s instead of %s\n", fold_case.expression, output.text, fold_case.folded);
+			if (!output.complete) printf("%s: not folded, it should be %s\n", fold_case.expression, fold_case.folded);
+		}
+	}
+	sp::deinit(tokens);
+	sp::deinit(nodes);
+	sp::deinit(labels);
+	return same;
+}
+
+
+
+int main(){
+	bool same = true;
+	for (const FoldCase &fold_case : FoldCases) same &= check_case(fold_case);
+	if (same) puts("constant folding gives the expected results");
+	return !same;
+}
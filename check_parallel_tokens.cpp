@@ -0,0 +1,111 @@
+#include "parallel_tokenizer.hpp"
+#include "source_loader.hpp"
+
+// Tokenizes every file serially and with make_tokens(input, size, thread_count) for several thread
+// counts and checks that tokens, names and symbols are the same. Files are repeated until they are
+// long enough to be split into chunks, the repetitions also start chunks inside of comments and strings.
+
+constexpr size_t CheckedThreadCounts[] = {1, 2, 3, 4, 7, 16};
+constexpr size_t CheckedTextSize = ParallelTokensMinChunk * 20;
+
+
+
+using TokenArray = sp::DynamicArray<Node, sp::MallocAllocator<>>;
+
+// fields of operator tokens that are not set by the tokenizer are not compared
+bool same_token(const Node &lhs, const Node &rhs) noexcept{
+	if (lhs.type!=rhs.type || lhs.pos!=rhs.pos) return false;
+	switch (lhs.type){
+	case NodeType::Integer:
+	case NodeType::Unsigned:
+	case NodeType::Double:
+	case NodeType::String:
+		return lhs.u16==rhs.u16 && lhs.data.u64==rhs.data.u64;
+	case NodeType::Float:
+		return lhs.u16==rhs.u16 && lhs.data.u32_array[0]==rhs.data.u32_array[0];
+	case NodeType::Character:
+	case NodeType::Name:
+		return lhs.data.u64 == rhs.data.u64;
+	default:
+		return true;
+	}
+}
+
+template<class T>
+bool same_array(const sp::DynamicArray<T, sp::MallocAllocator<>> &lhs, const sp::DynamicArray<T, sp::MallocAllocator<>> &rhs) noexcept{
+	return sp::len(lhs)==sp::len(rhs) && !memcmp(sp::beg(lhs), sp::beg(rhs), sp::len(lhs)*sizeof(T));
+}
+
+bool check_text(const char *path, const char *text, size_t size) noexcept{
+	TokenArray serial = make_tokens(text);
+	NameTables serial_tables;
+	swap_name_tables(serial_tables);
+
+	bool same = true;
+	for (size_t thread_count : CheckedThreadCounts){
+		TokenArray parallel = make_tokens(text, size, thread_count);
+		if (sp::len(parallel) != sp::len(serial)){
+			printf("%s: %zu threads: %zu tokens instead of %zu\n", path, thread_count, sp::len(parallel), sp::len(serial));
+			same = false;
+		} else{
+			size_t i = 0;
+			for (; i!=sp::len(serial) && same_token(serial[i], parallel[i]); ++i);
+			if (i != sp::len(serial)){
+				printf("%s: %zu threads: tokens differ at %zu\n", path, thread_count, i);
+				same = false;
+			}
+		}
+		if (!same_array(names, serial_tables.names)){
+			printf("%s: %zu threads: names differ\n", path, thread_count);
+			same = false;
+		}
+		if (!same_array(symbols, serial_tables.symbols)){
+			printf("%s: %zu threads: symbols differ\n", path, thread_count);
+			same = false;
+		}
+		sp::deinit(parallel);
+		NameTables parallel_tables;
+		swap_name_tables(parallel_tables);
+		sp::deinit(parallel_tables.names);
+		sp::deinit(parallel_tables.symbols);
+		sp::deinit(parallel_tables.symbol_slots);
+	}
+	sp::deinit(serial);
+	sp::deinit(serial_tables.names);
+	sp::deinit(serial_tables.symbols);
+	sp::deinit(serial_tables.symbol_slots);
+	return same;
+}
+
+
+
+int main(int argc, char **argv){
+	if (argc < 2){
+		fputs("usage: check_parallel_tokens file...\n", stderr);
+		return 1;
+	}
+
+	bool same = true;
+	for (int i=1; i!=argc; ++i){
+		SourceText source = load_source(argv[i]);
+		if (!source.ptr){
+			fprintf(stderr, "%s: file not found\n", argv[i]);
+			return 1;
+		}
+		if (source.size == 0){
+			free_source(source);
+			continue;
+		}
+
+		sp::DynamicArray<char, sp::MallocAllocator<>> text;
+		while (sp::len(text) < CheckedTextSize)
+			sp::push_range(text, sp::Range<const char>{source.ptr, source.size});
+		sp::push_value(text, '\0');
+		free_source(source);
+		code_text = sp::beg(text);
+		same &= check_text(argv[i], sp::beg(text), sp::len(text)-1);
+		sp::deinit(text);
+	}
+	if (same) puts("parallel tokens are the same as serial ones");
+	return !same;
+}
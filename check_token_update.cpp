@@ -0,0 +1,148 @@
+#include "source_loader.hpp"
+#include "token_update.hpp"
+
+// Applies random edits to every file, updates its tokens with update_tokens after each one and checks
+// that they are the same as the tokens of the whole edited text. A quarter of the edits is placed
+// at the start of the text, before or inside the first tokens.
+
+constexpr uint32_t CheckedEditCount = 2000;
+constexpr uint32_t CheckedMaxNesting = 24; // open braces are limited by the tokenizer
+
+// pieces of inserted text, they open and close comments, strings and scopes and merge with their neighbours
+constexpr const char *EditPieces[] = {
+	"a", "bc", "x1", "12", "1'000", "0x1f", "3.5", ".5", "5", "e", "'a'", "'", "\"s t\"", "\"", "\"\\n\"",
+	"#\"r\"#", "//c\n", "/*", "*/", "/* a /* b */ */", "+", "+=", "=", "==", "-", "->", ";", "(", ")",
+	"[", "]", "[+]", "[ ]", "{", "}", "{ x; }", ",", ":", ".", "..", "*", "/", "%", "&", "|", "^", "<<",
+	">>", " ", "\n", "\t", "if", "#run",
+};
+
+
+
+using TokenArray = sp::DynamicArray<Node, sp::MallocAllocator<>>;
+using TextArray = sp::DynamicArray<char, sp::MallocAllocator<>>;
+
+uint64_t random_state = 1;
+
+uint32_t random_below(uint32_t bound) noexcept{
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 7;
+	random_state ^= random_state << 17;
+	return bound ? (uint32_t)(random_state % bound) : 0;
+}
+
+bool same_range(sp::Range<const char> lhs, sp::Range<const char> rhs) noexcept{
+	return lhs.size==rhs.size && !memcmp(lhs.ptr, rhs.ptr, lhs.size);
+}
+
+// symbols and strings outside of the text are compared by their text, their ids and offsets
+// depend on the order in which they were added
+bool same_token(const Node &lhs, const Node &rhs, const char *text) noexcept{
+	if (lhs.type!=rhs.type || lhs.pos!=rhs.pos) return false;
+	switch (lhs.type){
+	case NodeType::Integer:
+	case NodeType::Unsigned:
+	case NodeType::Double:
+		return lhs.u16==rhs.u16 && lhs.data.u64==rhs.data.u64;
+	case NodeType::Float:
+		return lhs.u16==rhs.u16 && lhs.data.u32_array[0]==rhs.data.u32_array[0];
+	case NodeType::Character:
+		return lhs.data.u64 == rhs.data.u64;
+	case NodeType::String:
+		return lhs.u16==rhs.u16 && same_range(string_text(lhs, text), string_text(rhs, text));
+	case NodeType::Name:
+		return same_range(symbol_name(lhs.data.index), symbol_name(rhs.data.index));
+	default:
+		return true;
+	}
+}
+
+uint32_t brace_nesting(const TextArray &text) noexcept{
+	uint32_t depth = 0, max_depth = 0;
+	for (size_t i=0; i!=sp::len(text); ++i){
+		if (text[i] == '{' && ++depth > max_depth) max_depth = depth;
+		if (text[i] == '}' && depth) --depth;
+	}
+	return max_depth;
+}
+
+// text ends with '\0', which is not counted in its size, removals are longer while the text
+// is longer than the source, so its size stays around the size of the source
+TextEdit make_random_edit(const TextArray &text, TextArray &edited, uint32_t source_size) noexcept{
+	uint32_t size = sp::len(text) - 1;
+	TextEdit edit;
+	edit.offset = random_below(4) ? random_below(size+1) : random_below(size<10 ? size+1 : 10);
+	edit.removed = random_below(20) ? random_below(size>source_size ? 13 : 5) : random_below(60);
+	if (edit.removed > size-edit.offset) edit.removed = size - edit.offset;
+
+	sp::resize(edited, 0);
+	sp::push_range(edited, sp::Range<const char>{sp::beg(text), edit.offset});
+	for (uint32_t i=random_below(4); i; --i){
+		const char *piece = EditPieces[random_below(sp::len(EditPieces))];
+		sp::push_range(edited, sp::Range<const char>{piece, strlen(piece)});
+	}
+	edit.inserted = sp::len(edited) - edit.offset;
+	uint32_t rest = edit.offset + edit.removed;
+	sp::push_range(edited, sp::Range<const char>{sp::beg(text)+rest, sp::len(text)-rest});
+	return edit;
+}
+
+bool check_file(const char *path, SourceText source) noexcept{
+	TextArray text, edited;
+	sp::push_range(text, sp::Range<const char>{source.ptr, source.size});
+	sp::push_value(text, '\0');
+	TokenArray tokens = make_tokens(sp::beg(text));
+
+	bool same = true;
+	for (uint32_t i=0; i!=CheckedEditCount && same; ++i){
+		TextEdit edit = make_random_edit(text, edited, source.size);
+		if (brace_nesting(edited) > CheckedMaxNesting) continue;
+		sp::swap(text, edited);
+
+		update_tokens(tokens, sp::beg(text), edit);
+		TokenArray expected = make_tokens(sp::beg(text));
+		size_t j = 0;
+		if (sp::len(tokens) == sp::len(expected))
+			for (; j!=sp::len(tokens) && same_token(tokens[j], expected[j], sp::beg(text)); ++j);
+		if (sp::len(tokens)!=sp::len(expected) || j!=sp::len(tokens)){
+			printf("%s: edit %u (offset %u, removed %u, inserted %u): ", path, i, edit.offset, edit.removed, edit.inserted);
+			if (sp::len(tokens) != sp::len(expected))
+				printf("%zu tokens instead of %zu\n", sp::len(tokens), sp::len(expected));
+			else
+				printf("tokens differ at %zu\n", j);
+			same = false;
+		}
+		sp::deinit(expected);
+	}
+	sp::deinit(tokens);
+	sp::deinit(text);
+	sp::deinit(edited);
+	return same;
+}
+
+
+
+int main(int argc, char **argv){
+	if (argc < 2){
+		fputs("usage: check_token_update file...\n", stderr);
+		return 1;
+	}
+
+	// errors of the edited texts are expected, they are only collected
+	Diagnostic diagnostic_buffer[1];
+	DiagnosticSink sink{diagnostic_buffer, (uint32_t)sp::len(diagnostic_buffer)};
+	diagnostics = &sink;
+
+	bool same = true;
+	for (int i=1; i!=argc; ++i){
+		SourceText source = load_source(argv[i]);
+		if (!source.ptr){
+			fprintf(stderr, "%s: file not found\n", argv[i]);
+			return 1;
+		}
+		random_state = i;
+		same &= check_file(argv[i], source);
+		free_source(source);
+	}
+	if (same) puts("updated tokens are the same as the tokens of the edited texts");
+	return !same;
+}
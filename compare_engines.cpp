@@ -0,0 +1,188 @@
+#include <time.h>
+
+#include "main_parser.hpp"
+#include "source_loader.hpp"
+
+// Parses every file with both expression engines and checks that they give the same nodes,
+// labels and errors, then times parse_function with each of them. Expressions are also parsed
+// from every token of the file and of random strings of its tokens, which are mostly invalid,
+// there the returned token and the number of consumed tokens have to be the same too.
+
+constexpr uint32_t RandomStringCount = 2000;
+constexpr uint32_t RandomStringLength = 48;
+constexpr uint32_t TimedRunCount = 20;
+
+
+
+using TokenArray = sp::DynamicArray<Node, sp::MallocAllocator<>>;
+
+struct ParseOutput{
+	NodeArrayType nodes;
+	LabelArrayType labels;
+	Diagnostic diagnostics[64];
+	uint32_t diagnostic_count;
+	Node last;          // returned by parse_expression
+	size_t consumed;    // tokens
+	uint32_t body;      // returned by parse_function
+};
+
+void deinit(ParseOutput &output) noexcept{
+	sp::deinit(output.nodes);
+	sp::deinit(output.labels);
+}
+
+uint64_t random_state = 1;
+
+uint32_t random_below(uint32_t bound) noexcept{
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 7;
+	random_state ^= random_state << 17;
+	return (uint32_t)(random_state % bound);
+}
+
+double now_ms() noexcept{
+	timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec*1e3 + time.tv_nsec*1e-6;
+}
+
+bool same_node(const Node &lhs, const Node &rhs) noexcept{
+	return lhs.type==rhs.type && lhs.u16==rhs.u16 && lhs.pos==rhs.pos && lhs.data.u64==rhs.data.u64;
+}
+
+bool same_output(const ParseOutput &lhs, const ParseOutput &rhs) noexcept{
+	if (
+		sp::len(lhs.nodes)!=sp::len(rhs.nodes) || sp::len(lhs.labels)!=sp::len(rhs.labels)
+		|| lhs.diagnostic_count!=rhs.diagnostic_count || !same_node(lhs.last, rhs.last)
+		|| lhs.consumed!=rhs.consumed || lhs.body!=rhs.body
+	) return false;
+	for (size_t i=0; i!=sp::len(lhs.nodes); ++i)
+		if (!same_node(lhs.nodes[i], rhs.nodes[i])) return false;
+	if (memcmp(sp::beg(lhs.labels), sp::beg(rhs.labels), sp::len(lhs.labels)*sizeof(LabelInfo))) return false;
+	uint32_t count = lhs.diagnostic_count<64 ? lhs.diagnostic_count : 64;
+	for (uint32_t i=0; i!=count; ++i)
+		if (lhs.diagnostics[i].id!=rhs.diagnostics[i].id || lhs.diagnostics[i].pos!=rhs.diagnostics[i].pos)
+			return false;
+	return true;
+}
+
+template<ExpressionEngine Engine>
+void parse_with(ParseOutput &output, const Node *tokens, size_t start, bool whole_function) noexcept{
+	output = ParseOutput{};
+	output.last = Node{NodeType::Null, 0};
+	output.last.u16 = 0;
+	output.last.data.u64 = 0;
+
+	DiagnosticSink sink{output.diagnostics, (uint32_t)sp::len(output.diagnostics)};
+	diagnostics = &sink;
+	const Node *token_iter = tokens + start;
+	if (whole_function)
+		output.body = parse_function<Engine>(output.nodes, output.labels, &token_iter);
+	else
+		output.last = parse_expression_with<Engine>(output.nodes, &token_iter);
+	diagnostics = nullptr;
+	output.diagnostic_count = sink.count;
+	output.consumed = token_iter - tokens - start;
+}
+
+// parses from the start with both engines, prints the first difference
+bool compare_at(const char *path, const char *what, const Node *tokens, size_t start, bool whole_function) noexcept{
+	ParseOutput stack, pratt;
+	parse_with<ExpressionEngine::PrecedenceStack>(stack, tokens, start, whole_function);
+	parse_with<ExpressionEngine::Pratt>(pratt, tokens, start, whole_function);
+	bool same = same_output(stack, pratt);
+	if (!same) printf("%s: %s, token %zu: engines differ\n", path, what, start);
+	deinit(stack);
+	deinit(pratt);
+	return same;
+}
+
+template<ExpressionEngine Engine>
+double time_parse(const Node *tokens) noexcept{
+	NodeArrayType nodes;
+	LabelArrayType labels;
+	Diagnostic diagnostic_buffer[64];
+	DiagnosticSink sink{diagnostic_buffer, (uint32_t)sp::len(diagnostic_buffer)};
+	double best = 0;
+	for (uint32_t i=0; i!=TimedRunCount; ++i){
+		sp::resize(nodes, 0);
+		sp::resize(labels, 0);
+		sink.count = 0;
+		diagnostics = &sink;
+		const Node *token_iter = tokens;
+		double start = now_ms();
+		parse_function<Engine>(nodes, labels, &token_iter);
+		double time = now_ms() - start;
+		if (i==0 || time<best) best = time;
+	}
+	diagnostics = nullptr;
+	sp::deinit(nodes);
+	sp::deinit(labels);
+	return best;
+}
+
+bool compare_file(const char *path, const TokenArray &tokens) noexcept{
+	const Node *ptr = sp::beg(tokens);
+	size_t count = sp::len(tokens);
+	bool same = compare_at(path, "function", ptr, 0, true);
+	for (size_t i=0; i+1<count && same; ++i)
+		same = compare_at(path, "expression", ptr, i, false);
+
+	// random strings end with a terminator and the Null token of the text
+	TokenArray string;
+	for (uint32_t i=0; i!=RandomStringCount && same && count>1; ++i){
+		sp::resize(string, 0);
+		for (uint32_t j=random_below(RandomStringLength); j; --j){
+			sp::push_value(string, ptr[random_below(count-1)]);
+			sp::back(string).pos = sp::len(string) - 1;
+		}
+		Node end = ptr[count-1];
+		end.type = NodeType::Terminator;
+		end.pos = sp::len(string);
+		sp::push_value(string, end);
+		end.type = NodeType::Null;
+		sp::push_value(string, end);
+		for (size_t j=0; j+1<sp::len(string) && same; ++j)
+			same = compare_at(path, "random string", sp::beg(string), j, false);
+		if (!same) printf("%s: random string %u\n", path, i);
+	}
+	sp::deinit(string);
+	if (!same) return false;
+
+	double stack_time = time_parse<ExpressionEngine::PrecedenceStack>(ptr);
+	double pratt_time = time_parse<ExpressionEngine::Pratt>(ptr);
+	printf("%s: %zu tokens, precedence stack %.3f ms, Pratt %.3f ms\n", path, count, stack_time, pratt_time);
+	return true;
+}
+
+
+
+int main(int argc, char **argv){
+	if (argc < 2){
+		fputs("usage: compare_engines file...\n", stderr);
+		return 1;
+	}
+
+	bool same = true;
+	for (int i=1; i!=argc; ++i){
+		SourceText source = load_source(argv[i]);
+		if (!source.ptr){
+			fprintf(stderr, "%s: file not found\n", argv[i]);
+			return 1;
+		}
+		code_text = source.ptr;
+		random_state = i;
+
+		Diagnostic diagnostic_buffer[1];
+		DiagnosticSink sink{diagnostic_buffer, (uint32_t)sp::len(diagnostic_buffer)};
+		diagnostics = &sink;
+		TokenArray tokens = make_tokens(source.ptr);
+		diagnostics = nullptr;
+
+		same &= compare_file(argv[i], tokens);
+		sp::deinit(tokens);
+		free_source(source);
+	}
+	if (same) puts("both engines give the same output");
+	return !same;
+}
@@ -195,11 +195,12 @@ template<class T, class A, class TR>
 SP_CSI bool push_range(DynamicArray<T, A> &arr, Range<TR> range) noexcept{
 	size_t size = arr.size + range.size;
 	if (arr.data.size < size*sizeof(T)){
+		size_t new_size = 2*arr.data.size < size*sizeof(T) ? size*sizeof(T) : 2*arr.data.size;
 		Range<uint8_t> blk;
 		if constexpr (A::Alignment)
-			blk = realloc(*arr.allocator, arr.data, size);
+			blk = realloc(*arr.allocator, arr.data, new_size);
 		else
-			blk = realloc(*arr.allocator, arr.data, size, alignof(T));
+			blk = realloc(*arr.allocator, arr.data, new_size, alignof(T));
 		if (blk.ptr == nullptr) return true;
 		arr.data = blk;	
 	}
@@ -235,9 +236,9 @@ SP_CSI bool resize(DynamicArray<T, A> &arr, size_t size) noexcept{
 		if (arr.data.size < size*sizeof(T)){
 			Range<uint8_t> blk;
 			if constexpr (A::Alignment)
-				blk = realloc(*arr.allocator, arr.data, size);
+				blk = realloc(*arr.allocator, arr.data, size*sizeof(T));
 			else
-				blk = realloc(*arr.allocator, arr.data, size, alignof(T));
+				blk = realloc(*arr.allocator, arr.data, size*sizeof(T), alignof(T));
 			if (blk.ptr == nullptr) return true;
 			arr.data = blk;	
 		}
@@ -265,11 +266,12 @@ template<class T, class A>
 SP_CSI bool expand_back(DynamicArray<T, A> &arr, size_t amount) noexcept{
 	size_t size = arr.size + amount;
 	if (arr.data.size < size*sizeof(T)){
+		size_t new_size = 2*arr.data.size < size*sizeof(T) ? size*sizeof(T) : 2*arr.data.size;
 		Range<uint8_t> blk;
 		if constexpr (A::Alignment)
-			blk = realloc(*arr.allocator, arr.data, size);
+			blk = realloc(*arr.allocator, arr.data, new_size);
 		else
-			blk = realloc(*arr.allocator, arr.data, size, alignof(T));
+			blk = realloc(*arr.allocator, arr.data, new_size, alignof(T));
 		if (blk.ptr == nullptr) return true;
 		arr.data = blk;	
 	}
@@ -302,8 +304,129 @@ template<class T, class A> constexpr bool needs_deinit<DynamicArray<T, A>> = tru
 template<class T, class A>
 SP_CSI void deinit(DynamicArray<T, A> &arr) noexcept{
 	if constexpr (needs_deinit<T>)
-		for (size_t i=0; i!=arr.size; ++i) deinit(*((T *)arr.data.ptr+1));
-	free(arr.allocator, arr.data);
+		for (size_t i=0; i!=arr.size; ++i) deinit(*((T *)arr.data.ptr+i));
+	free(*arr.allocator, arr.data);
+}
+
+
+
+
+
+// array that keeps first C elements inside of itself and moves all of them to the memory
+// of the allocator when it grows past that, data.ptr is null while the inline storage is used
+template<class T, size_t C, class A>
+struct SmallArray{
+	SP_CI T &operator [](size_t index) noexcept{ return beg(*this)[index]; }
+	SP_CI const T &operator [](size_t index) const noexcept{ return beg(*this)[index]; }
+
+	typedef T ValueType;
+	constexpr static size_t Capacity = C;
+	static_assert(Capacity > 0, "this makes no sense");
+
+	A *allocator = nullptr;
+	Range<uint8_t> data = {nullptr, 0};
+	size_t size = 0;
+	union{
+		T storage[C];
+	};
+};
+
+template<class T, size_t C, class A>
+SP_CSI T *beg(const SmallArray<T, C, A> &arr) noexcept{
+	return arr.data.ptr ? (T *)arr.data.ptr : (T *)arr.storage;
+}
+
+template<class T, size_t C, class A>
+SP_CSI T *end(const SmallArray<T, C, A> &arr) noexcept{ return beg(arr) + arr.size; }
+
+template<class T, size_t C, class A>
+SP_CSI size_t len(const SmallArray<T, C, A> &arr) noexcept{ return arr.size; }
+
+template<class T, size_t C, class A>
+SP_CSI size_t cap(const SmallArray<T, C, A> &arr) noexcept{
+	return arr.data.ptr ? arr.data.size / sizeof(T) : C;
+}
+
+template<class T, size_t C, class A>
+SP_CSI T &front(SmallArray<T, C, A> &arr) noexcept{ return *beg(arr); }
+
+template<class T, size_t C, class A>
+SP_CSI T &back(SmallArray<T, C, A> &arr) noexcept{ return beg(arr)[arr.size - 1]; }
+
+namespace priv__{
+
+// elements are moved bytewise, the same as when the allocator reallocates them
+template<class T, size_t C, class A>
+bool grow_small_array(SmallArray<T, C, A> &arr) noexcept{
+	size_t new_size = 2 * cap(arr) * sizeof(T);
+	Range<uint8_t> blk;
+	if (arr.data.ptr){
+		if constexpr (A::Alignment)
+			blk = realloc(*arr.allocator, arr.data, new_size);
+		else
+			blk = realloc(*arr.allocator, arr.data, new_size, alignof(T));
+	} else{
+		if constexpr (A::Alignment)
+			blk = alloc(*arr.allocator, new_size);
+		else
+			blk = alloc(*arr.allocator, new_size, alignof(T));
+		if (blk.ptr){
+			const uint8_t *source = (const uint8_t *)arr.storage;
+			for (uint8_t *I=blk.ptr; I!=blk.ptr+arr.size*sizeof(T); ++I, ++source) *I = *source;
+		}
+	}
+	if (blk.ptr == nullptr) return true;
+	arr.data = blk;
+	return false;
+}
+
+} // END OF NAMESPACE priv__
+
+template<class T, size_t C, class A>
+SP_CSI bool push(SmallArray<T, C, A> &arr) noexcept{
+	[[unlikely]] if (arr.size == cap(arr))
+		if (priv__::grow_small_array(arr)) return true;
+	if constexpr (needs_init<T>) init(beg(arr)[arr.size]);
+	++arr.size;
+	return false;
+}
+
+template<class T, size_t C, class A, class TV>
+SP_CSI bool push_value(SmallArray<T, C, A> &arr, const TV &value) noexcept{
+	if (push(arr)) return true;
+	copy(beg(arr)[arr.size - 1], value);
+	return false;
+}
+
+template<class T, size_t C, class A>
+SP_CSI void pop(SmallArray<T, C, A> &arr) noexcept{
+	--arr.size;
+	if constexpr (needs_deinit<T>) deinit(beg(arr)[arr.size]);
+}
+
+template<class T, size_t C, class A>
+SP_CSI T &&pop_val(SmallArray<T, C, A> &arr) noexcept{
+	--arr.size;
+	return (T &&)beg(arr)[arr.size];
+}
+
+template<class T, size_t C, class A>
+SP_CSI bool is_empty(const SmallArray<T, C, A> &arr) noexcept{ return arr.size == 0; }
+
+template<class T, size_t C, class A> constexpr bool needs_init<SmallArray<T, C, A>> = true;
+template<class T, size_t C, class A> constexpr bool needs_deinit<SmallArray<T, C, A>> = true;
+
+template<class T, size_t C, class A>
+SP_CSI void init(SmallArray<T, C, A> &arr) noexcept{
+	arr.data = Range<uint8_t>{nullptr, 0};
+	arr.size = 0;
+}
+
+template<class T, size_t C, class A>
+SP_CSI void deinit(SmallArray<T, C, A> &arr) noexcept{
+	if constexpr (needs_deinit<T>)
+		for (size_t i=0; i!=arr.size; ++i) deinit(beg(arr)[i]);
+	if (arr.data.ptr) free(*arr.allocator, arr.data);
 }
 
 
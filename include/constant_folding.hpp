@@ -0,0 +1,434 @@
+#pragma once
+
+#include <bit>
+
+#include "subtree_index.hpp"
+
+// Subtrees of an expression whose operands are number literals are replaced by their value.
+// The pass goes once through the prefix ordered output of parse_expression, every node is copied
+// to the front of the part that is still not read, so the nodes are compacted while they are folded.
+// Operators are folded only when their result is exact:
+//   - signed integers are not folded when they overflow and nothing is divided by zero,
+//   - integer literals without a suffix from 2^63 up have no signed value and are not folded,
+//   - unsigned integers wrap around,
+//   - floats are computed with the precision of their type,
+//   - logical operators and comparisons give an unsigned 1 or 0,
+//   - operators with two results give an array literal of both of them:
+//     +% and -% the value and a carry, borrow or overflow flag, *% the low and the high half,
+//     /% the quotient and the remainder,
+//   - casts are folded for the number types named in NumberTypeNames.
+
+struct NumberTypeName{
+	const char *name;
+	NodeType type;
+	uint8_t bits;
+};
+
+constexpr NumberTypeName NumberTypeNames[] = {
+	{"i8",  NodeType::Integer,  8}, {"i16", NodeType::Integer,  16},
+	{"i32", NodeType::Integer,  32}, {"i64", NodeType::Integer,  64},
+	{"u8",  NodeType::Unsigned, 8}, {"u16", NodeType::Unsigned, 16},
+	{"u32", NodeType::Unsigned, 32}, {"u64", NodeType::Unsigned, 64},
+	{"f32", NodeType::Float,    32}, {"f64", NodeType::Double,   64},
+};
+
+
+
+// VALUES OF LITERALS
+namespace priv__{
+
+SP_CSI bool is_number_literal(NodeType type) noexcept{
+	return NodeType::Integer<=type && type<=NodeType::Character;
+}
+
+SP_CSI bool is_integer_literal(NodeType type) noexcept{
+	return type==NodeType::Integer || type==NodeType::Unsigned;
+}
+
+// literals without a suffix that do not fit into 63 bits are Integer tokens too, u16 is 64 for them,
+// INT64_MIN is left with them, since it is 64 bits wide as well
+SP_CSI bool has_signed_value(const Node &node) noexcept{
+	return node.type!=NodeType::Integer || node.u16<64;
+}
+
+// u16 holds the number of bits required to store the value, without the sign
+inline Node make_integer_literal(NodeType type, uint64_t value, uint32_t pos) noexcept{
+	Node node{type, pos};
+	uint64_t magnitude = type==NodeType::Integer && (int64_t)value<0 ? -value : value;
+	node.u16 = std::bit_width(magnitude);
+	node.data.u64 = value;
+	return node;
+}
+
+inline Node make_truth_literal(bool value, uint32_t pos) noexcept{
+	return make_integer_literal(NodeType::Unsigned, value, pos);
+}
+
+inline Node make_float_literal(float value, uint32_t pos) noexcept{
+	Node node{NodeType::Float, pos};
+	node.u16 = 0;
+	node.data.u64 = 0;
+	node.data.f32 = value;
+	return node;
+}
+
+inline Node make_double_literal(double value, uint32_t pos) noexcept{
+	Node node{NodeType::Double, pos};
+	node.u16 = 0;
+	node.data.f64 = value;
+	return node;
+}
+
+// folded values, count is 0 when the operation is not folded
+struct FoldResult{
+	Node nodes[3];
+	uint32_t count = 0;
+};
+
+inline void set_single(FoldResult &result, const Node &node) noexcept{
+	result.nodes[0] = node;
+	result.count = 1;
+}
+
+inline void set_pair(FoldResult &result, const Node &first, const Node &second, uint32_t pos) noexcept{
+	result.nodes[0] = Node{NodeType::ArrayLiteral, pos};
+	result.nodes[0].u16 = 0;
+	result.nodes[0].data.size = 2;
+	result.nodes[1] = first;
+	result.nodes[2] = second;
+	result.count = 3;
+}
+
+} // END OF NAMESPACE priv__
+
+
+
+// OPERATORS
+namespace priv__{
+
+inline FoldResult fold_unary(const Node &op, const Node &value, uint32_t pos) noexcept{
+	FoldResult result;
+	NodeType type = value.type;
+	if (!has_signed_value(value)) return result;
+	switch (op.type){
+	case NodeType::Plus:
+		if (type != NodeType::Character) set_single(result, Node{value});
+		break;
+	case NodeType::Minus:
+		if (type == NodeType::Integer){
+			if (value.data.u64 != (uint64_t)INT64_MIN)
+				set_single(result, make_integer_literal(type, -value.data.u64, pos));
+		} else if (type == NodeType::Unsigned){
+			set_single(result, make_integer_literal(type, -value.data.u64, pos));
+		} else if (type == NodeType::Float){
+			set_single(result, make_float_literal(-value.data.f32, pos));
+		} else if (type == NodeType::Double){
+			set_single(result, make_double_literal(-value.data.f64, pos));
+		}
+		break;
+	case NodeType::LogicNot:
+		if (is_integer_literal(type)) set_single(result, make_truth_literal(!value.data.u64, pos));
+		break;
+	case NodeType::BitNot:
+		if (is_integer_literal(type)) set_single(result, make_integer_literal(type, ~value.data.u64, pos));
+		break;
+	default:;
+	}
+	if (result.count) result.nodes[0].pos = pos;
+	return result;
+}
+
+template<class T>
+SP_CSI bool compare_values(NodeType op, T lhs, T rhs) noexcept{
+	switch (op){
+	case NodeType::Equal:        return lhs == rhs;
+	case NodeType::NotEqual:     return lhs != rhs;
+	case NodeType::Lesser:       return lhs < rhs;
+	case NodeType::Greater:      return lhs > rhs;
+	case NodeType::LesserEqual:  return lhs <= rhs;
+	default:                     return lhs >= rhs;
+	}
+}
+
+inline FoldResult fold_signed(NodeType op, int64_t lhs, int64_t rhs, uint32_t pos) noexcept{
+	FoldResult result;
+	int64_t value;
+	constexpr NodeType Int = NodeType::Integer;
+	switch (op){
+	case NodeType::Add:
+		if (!__builtin_add_overflow(lhs, rhs, &value)) set_single(result, make_integer_literal(Int, value, pos));
+		break;
+	case NodeType::Subtract:
+		if (!__builtin_sub_overflow(lhs, rhs, &value)) set_single(result, make_integer_literal(Int, value, pos));
+		break;
+	case NodeType::Multiply:
+		if (!__builtin_mul_overflow(lhs, rhs, &value)) set_single(result, make_integer_literal(Int, value, pos));
+		break;
+	case NodeType::Divide:
+	case NodeType::Modulo:
+	case NodeType::ModuloDivide:
+		if (!rhs || (lhs==INT64_MIN && rhs==-1)) break;
+		if (op == NodeType::Divide){
+			set_single(result, make_integer_literal(Int, lhs / rhs, pos));
+		} else if (op == NodeType::Modulo){
+			set_single(result, make_integer_literal(Int, lhs % rhs, pos));
+		} else{
+			set_pair(result, make_integer_literal(Int, lhs/rhs, pos), make_integer_literal(Int, lhs%rhs, pos), pos);
+		}
+		break;
+	case NodeType::BitOr:  set_single(result, make_integer_literal(Int, lhs | rhs, pos)); break;
+	case NodeType::BitNor: set_single(result, make_integer_literal(Int, ~(lhs | rhs), pos)); break;
+	case NodeType::BitAnd: set_single(result, make_integer_literal(Int, lhs & rhs, pos)); break;
+	case NodeType::BitNand: set_single(result, make_integer_literal(Int, ~(lhs & rhs), pos)); break;
+	case NodeType::BitXor: set_single(result, make_integer_literal(Int, lhs ^ rhs, pos)); break;
+	case NodeType::CarryAdd:{
+			bool overflow = __builtin_add_overflow(lhs, rhs, &value);
+			set_pair(result, make_integer_literal(Int, value, pos), make_truth_literal(overflow, pos), pos);
+		} break;
+	case NodeType::BorrowSubtract:{
+			bool overflow = __builtin_sub_overflow(lhs, rhs, &value);
+			set_pair(result, make_integer_literal(Int, value, pos), make_truth_literal(overflow, pos), pos);
+		} break;
+	case NodeType::WideMultiply:{ // value is high * 2^64 + low, low half is unsigned
+			__int128 product = (__int128)lhs * rhs;
+			set_pair(
+				result,
+				make_integer_literal(NodeType::Unsigned, (uint64_t)product, pos),
+				make_integer_literal(Int, (uint64_t)(product >> 64), pos), pos
+			);
+		} break;
+	default:
+		if (NodeType::Equal<=op && op<=NodeType::GreaterEqual)
+			set_single(result, make_truth_literal(compare_values(op, lhs, rhs), pos));
+	}
+	return result;
+}
+
+inline FoldResult fold_unsigned(NodeType op, uint64_t lhs, uint64_t rhs, uint32_t pos) noexcept{
+	FoldResult result;
+	uint64_t value;
+	constexpr NodeType Uint = NodeType::Unsigned;
+	switch (op){
+	case NodeType::Add:      set_single(result, make_integer_literal(Uint, lhs + rhs, pos)); break;
+	case NodeType::Subtract: set_single(result, make_integer_literal(Uint, lhs - rhs, pos)); break;
+	case NodeType::Multiply: set_single(result, make_integer_literal(Uint, lhs * rhs, pos)); break;
+	case NodeType::Divide:
+		if (rhs) set_single(result, make_integer_literal(Uint, lhs / rhs, pos));
+		break;
+	case NodeType::Modulo:
+		if (rhs) set_single(result, make_integer_literal(Uint, lhs % rhs, pos));
+		break;
+	case NodeType::ModuloDivide:
+		if (rhs) set_pair(result, make_integer_literal(Uint, lhs/rhs, pos), make_integer_literal(Uint, lhs%rhs, pos), pos);
+		break;
+	case NodeType::BitOr:  set_single(result, make_integer_literal(Uint, lhs | rhs, pos)); break;
+	case NodeType::BitNor: set_single(result, make_integer_literal(Uint, ~(lhs | rhs), pos)); break;
+	case NodeType::BitAnd: set_single(result, make_integer_literal(Uint, lhs & rhs, pos)); break;
+	case NodeType::BitNand: set_single(result, make_integer_literal(Uint, ~(lhs & rhs), pos)); break;
+	case NodeType::BitXor: set_single(result, make_integer_literal(Uint, lhs ^ rhs, pos)); break;
+	case NodeType::CarryAdd:{
+			bool carry = __builtin_add_overflow(lhs, rhs, &value);
+			set_pair(result, make_integer_literal(Uint, value, pos), make_truth_literal(carry, pos), pos);
+		} break;
+	case NodeType::BorrowSubtract:{
+			bool borrow = __builtin_sub_overflow(lhs, rhs, &value);
+			set_pair(result, make_integer_literal(Uint, value, pos), make_truth_literal(borrow, pos), pos);
+		} break;
+	case NodeType::WideMultiply:{
+			unsigned __int128 product = (unsigned __int128)lhs * rhs;
+			set_pair(
+				result,
+				make_integer_literal(Uint, (uint64_t)product, pos),
+				make_integer_literal(Uint, (uint64_t)(product >> 64), pos), pos
+			);
+		} break;
+	default:
+		if (NodeType::Equal<=op && op<=NodeType::GreaterEqual)
+			set_single(result, make_truth_literal(compare_values(op, lhs, rhs), pos));
+	}
+	return result;
+}
+
+template<class T>
+inline FoldResult fold_floating(NodeType op, T lhs, T rhs, uint32_t pos) noexcept{
+	FoldResult result;
+	T value;
+	switch (op){
+	case NodeType::Add:      value = lhs + rhs; break;
+	case NodeType::Subtract: value = lhs - rhs; break;
+	case NodeType::Multiply: value = lhs * rhs; break;
+	case NodeType::Divide:   value = lhs / rhs; break;
+	case NodeType::Modulo:   value = __builtin_fmod(lhs, rhs); break;
+	default:
+		if (NodeType::Equal<=op && op<=NodeType::GreaterEqual)
+			set_single(result, make_truth_literal(compare_values(op, lhs, rhs), pos));
+		return result;
+	}
+	if constexpr (sizeof(T) == sizeof(float)){
+		set_single(result, make_float_literal(value, pos));
+	} else{
+		set_single(result, make_double_literal(value, pos));
+	}
+	return result;
+}
+
+inline FoldResult fold_binary(const Node &op, const Node &lhs, const Node &rhs, uint32_t pos) noexcept{
+	NodeType type = lhs.type;
+	if (!has_signed_value(lhs) || !has_signed_value(rhs)) return FoldResult{};
+	switch (op.type){
+	case NodeType::LogicOr:
+	case NodeType::LogicAnd:
+		if (!is_integer_literal(type) || !is_integer_literal(rhs.type)) return FoldResult{};
+		return FoldResult{{make_truth_literal(
+			op.type==NodeType::LogicOr ? lhs.data.u64||rhs.data.u64 : lhs.data.u64&&rhs.data.u64, pos
+		)}, 1};
+	case NodeType::LeftShift:
+	case NodeType::RightShift:{
+			// amount can be of any integer type, but it has to be smaller than the width
+			if (!is_integer_literal(type) || !is_integer_literal(rhs.type) || rhs.data.u64>=64)
+				return FoldResult{};
+			uint64_t amount = rhs.data.u64;
+			uint64_t value = lhs.data.u64;
+			if (op.type == NodeType::RightShift){
+				value = type==NodeType::Integer ? (uint64_t)((int64_t)value >> amount) : value >> amount;
+			} else{
+				value <<= amount;
+				if (type==NodeType::Integer && ((int64_t)value>>amount) != (int64_t)lhs.data.u64)
+					return FoldResult{}; // bits of the value are shifted out
+			}
+			return FoldResult{{make_integer_literal(type, value, pos)}, 1};
+		}
+	default:;
+	}
+
+	if (type != rhs.type) return FoldResult{};
+	switch (type){
+	case NodeType::Integer:
+		return fold_signed(op.type, lhs.data.u64, rhs.data.u64, pos);
+	case NodeType::Unsigned:
+		return fold_unsigned(op.type, lhs.data.u64, rhs.data.u64, pos);
+	case NodeType::Float:
+		return fold_floating(op.type, lhs.data.f32, rhs.data.f32, pos);
+	case NodeType::Double:
+		return fold_floating(op.type, lhs.data.f64, rhs.data.f64, pos);
+	default: // characters are only compared
+		if (NodeType::Equal<=op.type && op.type<=NodeType::GreaterEqual)
+			return FoldResult{{make_truth_literal(compare_values(op.type, lhs.data.u64, rhs.data.u64), pos)}, 1};
+		return FoldResult{};
+	}
+}
+
+inline const NumberTypeName *find_number_type(const Node &name) noexcept{
+	sp::Range<const char> text = symbol_name(name.data.index);
+	for (const NumberTypeName &type : NumberTypeNames)
+		if (__builtin_strlen(type.name)==text.size && !__builtin_memcmp(type.name, text.ptr, text.size))
+			return &type;
+	return nullptr;
+}
+
+// integers are truncated to the width of the type, floats have to fit into it after truncation
+inline FoldResult fold_cast(const Node &type_name, const Node &value, uint32_t pos) noexcept{
+	FoldResult result;
+	const NumberTypeName *target = find_number_type(type_name);
+	if (!target || !has_signed_value(value)) return result;
+
+	if (target->type == NodeType::Float){
+		float number;
+		switch (value.type){
+		case NodeType::Integer: number = (float)(int64_t)value.data.u64; break;
+		case NodeType::Float:   number = value.data.f32; break;
+		case NodeType::Double:  number = (float)value.data.f64; break;
+		default:                number = (float)value.data.u64;
+		}
+		set_single(result, make_float_literal(number, pos));
+		return result;
+	}
+	if (target->type == NodeType::Double){
+		double number;
+		switch (value.type){
+		case NodeType::Integer: number = (double)(int64_t)value.data.u64; break;
+		case NodeType::Float:   number = value.data.f32; break;
+		case NodeType::Double:  number = value.data.f64; break;
+		default:                number = (double)value.data.u64;
+		}
+		set_single(result, make_double_literal(number, pos));
+		return result;
+	}
+
+	uint64_t bits;
+	if (value.type==NodeType::Float || value.type==NodeType::Double){
+		double number = value.type==NodeType::Float ? (double)value.data.f32 : value.data.f64;
+		number = __builtin_trunc(number);
+		bool is_signed = target->type == NodeType::Integer;
+		double upper = __builtin_ldexp(1.0, target->bits - is_signed);
+		double lower = is_signed ? -upper : 0.0;
+		if (!(lower<=number && number<upper)) return result; // also rejects NaN
+		bits = is_signed ? (uint64_t)(int64_t)number : (uint64_t)number;
+	} else{
+		bits = value.data.u64;
+	}
+	if (target->bits != 64){
+		uint32_t unused = 64 - target->bits;
+		bits = target->type == NodeType::Integer
+			? (uint64_t)((int64_t)(bits << unused) >> unused)
+			: bits << unused >> unused;
+	}
+	set_single(result, make_integer_literal(target->type, bits, pos));
+	return result;
+}
+
+struct FoldFrame{
+	uint32_t out;       // index of the operator in the output
+	uint32_t remaining; // children that were not read yet
+};
+
+} // END OF NAMESPACE priv__
+
+
+
+// folds the expressions from the first index to the end of nodes,
+// returns the number of nodes that were removed
+size_t fold_constants(NodeArrayType &nodes, size_t first) noexcept{
+	using namespace priv__;
+	Node *ptr = sp::beg(nodes);
+	size_t size = sp::len(nodes);
+	size_t out = first;
+	sp::SmallArray<FoldFrame, 32, sp::MallocAllocator<>> frames;
+
+	for (size_t i=first; i!=size; ++i){
+		Node node = ptr[i];
+		ptr[out] = node;
+		size_t arity = expression_arity(node);
+		++out;
+		if (arity){
+			sp::push_value(frames, FoldFrame{(uint32_t)out-1, (uint32_t)arity});
+			continue;
+		}
+
+		// a finished subtree is a child of the operator on the top, so operators are folded
+		// from the bottom when their last child is finished
+		while (!sp::is_empty(frames) && !--sp::back(frames).remaining){
+			FoldFrame frame = sp::pop_val(frames);
+			const Node &op = ptr[frame.out];
+			const Node *children = ptr + frame.out + 1;
+			size_t child_count = out - frame.out - 1;
+			FoldResult result;
+			if (child_count == 1){
+				if (is_number_literal(children[0].type)) result = fold_unary(op, children[0], op.pos);
+			} else if (child_count==2 && is_number_literal(children[1].type)){
+				uint32_t pos = children[0].pos<op.pos ? children[0].pos : op.pos;
+				if (op.type == NodeType::Cast){
+					if (children[0].type == NodeType::Name) result = fold_cast(children[0], children[1], pos);
+				} else if (is_number_literal(children[0].type) && expression_arity(op)==2){
+					result = fold_binary(op, children[0], children[1], pos);
+				}
+			}
+			if (!result.count) continue;
+			for (uint32_t j=0; j!=result.count; ++j) ptr[frame.out+j] = result.nodes[j];
+			out = frame.out + result.count;
+		}
+	}
+	sp::deinit(frames);
+	sp::resize(nodes, out);
+	return size - out;
+}
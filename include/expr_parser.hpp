@@ -1,3 +1,5 @@
+#pragma once
+
 #include "tokenizer.hpp"
 
 // there are 3 namespace which elements of it cannot collide
@@ -10,107 +12,108 @@
 // golbal valiebles cannot collide with each self
 
 
-uint8_t prec_table[] = {
-	1,  1,            // Comma, Slice
-	20, 17, 20,       // OpenPar, OpenBrace, OpenBracket,
-	20, 17, 20,       // GetProcedure, GetSomethingInBraces, GetField,
-	
-// LEFT TO RIGHT
-	3,                // LogicOr,
-	4,                // LogicAnd,
-	5, 5, 5, 5, 5, 5, // Equal, NotEqual, Lesser, Greater, LesserEqual, GreaterEqual,
-	6, 6,             // Add, Subtract,
-	7, 7,             // Multiply, Divide,
-	8,                // Modulo,
-	9,                // Concatenate,
-	10, 10,           // BitOr, BitNor,
-	11, 11,           // BitAnd, BitNand,
-	12,               // BitXor,
-	13, 13,           // LeftShift, RightShift, 
-	
-	6, 6,             // ArrayAdd, ArraySubtract,
-	7, 7,             // ArrayMultiply, ArrayDivide,
-	8,                // ArrayModulo,
-	9,                // ArrayConcatenate,
-	10, 10,           // ArrayBitOr, ArrayBitNor,
-	11, 11,           // ArrayBitAnd, ArrayBitNand,
-	12,               // ArrayBitXor,
-	13, 13,           // ArrayLeftShift, ArrayRightShift,
-	
-	6, 6,             // CarryAdd, BorrowSubtract,
-	7, 7,             // WideMultiply, ModuloDivide,
-	18,               // Access,
-
-// RIGHT TO LEFT
-	2, 2,             // Assign, ExpandAssign,
-	2, 2,             // AddAssign, SubtractAssign,
-	2, 2,             // MultiplyAssign, DivideAssign,
-	2,                // ModuloAssign,
-	2,                // ConcatenateAssign,
-	2, 2,             // BitOrAssign, BitNorAssign,
-	2, 2,             // BitAndAssign, BitNandAssign,
-	2,                // BitXorAssign,
-	2, 2,             // LeftShiftAssign, RightShiftAssign, 
-	2, 2,             // ArrayAddAssign, ArraySubtractAssign,
-	2, 2,             // ArrayMultiplyAssign, ArrayDivideAssign,
-	2,                // ArrayModuloAssign,
-	2,                // ArrayConcatenateAssign,
-	2, 2,             // ArrayBitOrAssign, ArrayBitNorAssign,
-	2, 2,             // ArrayBitAndAssign, ArrayBitNandAssign,
-	2,                // ArrayBitXorAssign,
-	2, 2,             // ArrayLeftShiftAssign, ArrayRightShiftAssign,	
-	
-	1,                // Ternary,
-	16, 16,           // Cast, Reinterpret,
+// finisher equal to NodeType::Comma means that expression should be termianted with comma
+struct ParamInfo{
+	uint32_t index; // place of the node for lists, otherwise position of the opening token
+	NodeType finisher;
+	bool is_list;
+	bool expects_value;
 };
 
+SP_CSI bool is_closing_token(NodeType type) noexcept{
+	return (
+		type==NodeType::ClosePar || type==NodeType::CloseBrace
+		|| type==NodeType::CloseBracket || type==NodeType::CloseDoubleBracket
+	);
+}
 
+// the closing token does not close the innermost bracket
+SP_CSI ErrorId too_many_closing_error(NodeType closer) noexcept{
+	switch (closer){
+	case NodeType::ClosePar: return ErrorId::TooManyClosingParenthesis;
+	case NodeType::CloseBrace: return ErrorId::TooManyClosingBraces;
+	case NodeType::CloseBracket: return ErrorId::TooManyClosingBrackets;
+	default: return ErrorId::TooManyClosingDoubleBrackets;
+	}
+}
 
-SP_CSI size_t right_to_left(NodeType t) noexcept{ return t >= NodeType::Assign; }
-
-template<class T, class A>
-SP_CSI void insert(sp::DynamicArray<T, A> &arr, size_t pos, const T &value) noexcept{
-	sp::push(arr);
-	for (size_t i=sp::len(arr); --i!=pos;) arr[i] = arr[i-1];
-	arr[pos] = value;
+// the expression ended before the bracket closed with the token
+SP_CSI ErrorId unmatched_error(NodeType closer) noexcept{
+	switch (closer){
+	case NodeType::ClosePar: return ErrorId::UnmatchedParenthesis;
+	case NodeType::CloseBrace: return ErrorId::UnmatchedBraces;
+	case NodeType::CloseBracket: return ErrorId::UnmatchedBrackets;
+	default: return ErrorId::UnmatchedDoubleBrackets;
+	}
 }
 
+using NodeArrayType = sp::DynamicArray<Node, sp::MallocAllocator<>>;
 
 
-// finisher equal to NodeType::Comma means that expression should be termianted with comma
-struct ParamInfo{
-	uint32_t index;
-	NodeType finisher;
-	bool is_list;
-	bool expects_value;
-};
+// OUTPUT OF AN EXPRESSION
+// nodes are appended in the order in which they are parsed and linked in the order of the output,
+// so operators are placed in front of their left operands without moving the nodes after them,
+// slot 0 is the start of the output and slot i is the i-th node appended by the expression,
+// places in the output are refered to by the slot after which they are
+namespace priv__{
 
-using NodeArrayType = sp::DynamicArray<Node, sp::MallocAllocator<>>;
+thread_local sp::DynamicArray<uint32_t, sp::MallocAllocator<>> expression_links;
+
+inline void place_expression_node(NodeArrayType &nodes, const Node &node, uint32_t after, uint32_t &last) noexcept{
+	sp::push_value(nodes, node);
+	uint32_t slot = sp::len(expression_links);
+	uint32_t next = expression_links[after];
+	sp::push_value(expression_links, next);
+	expression_links[after] = slot;
+	if (after == last) last = slot;
+}
+
+inline Node &expression_node(NodeArrayType &nodes, size_t first, uint32_t place) noexcept{
+	return nodes[first + expression_links[place] - 1];
+}
+
+// nodes of the expression are put into the order of the output with a single pass
+inline void order_expression_nodes(NodeArrayType &nodes, size_t first) noexcept{
+	size_t count = sp::len(nodes) - first;
+	sp::resize(nodes, first + 2*count);
+	Node *output = sp::beg(nodes) + first + count;
+	for (uint32_t slot=expression_links[0]; slot; slot=expression_links[slot])
+		*output++ = nodes[first + slot - 1];
+	memcpy(sp::beg(nodes)+first, sp::beg(nodes)+first+count, count*sizeof(Node));
+	sp::resize(nodes, first+count);
+}
+
+} // END OF NAMESPACE priv__
 
+// TokenIter is either a pointer into the token array or a TokenCursor
+template<class TokenIter>
 Node parse_expression(
 	NodeArrayType &nodes,
-	const Node **token_iter
+	TokenIter *token_iter
 ) noexcept{ // returns last node
-	sp::FiniteArray<uint32_t [2], 32> precs;
-	sp::FiniteArray<ParamInfo, 32> context;
+	// nesting is not limited, stacks are moved to the heap when it gets deep
+	sp::SmallArray<uint32_t [2], 32, sp::MallocAllocator<>> precs;
+	sp::SmallArray<ParamInfo, 32, sp::MallocAllocator<>> context;
 	sp::push_value(precs, (uint32_t [2]){0, 0});
 	sp::push_value(context, ParamInfo{0, NodeType(0), false, false});
 	size_t prec_offset = 0;
+
+	size_t first = sp::len(nodes);
+	uint32_t last = 0; // slot of the last node in the output
+	bool reordered = false;
+	sp::resize(priv__::expression_links, 1);
+	priv__::expression_links[0] = 0;
 	
-	const char *ClosingNameTable[] = {
-		"parenthesis", "braces", "square brackets", "double square brackets"
- 	};
-	
-	const Node *token = *token_iter;
+	TokenIter token = *token_iter;
 	Node op_node;
 	for (;;){
 	Continue:
-		size_t end_pos = sp::len(nodes);
+		uint32_t end_pos = last;
 
 		op_node = *token;
 		++token;
 		
-		size_t unary_prec = 14 + prec_offset;
+		size_t unary_prec = prec_offset; // the bracket opened by the operator does not raise it
 		switch (op_node.type){
 			case NodeType::Add:
 				op_node.type = NodeType::Plus;
@@ -119,14 +122,11 @@ Node parse_expression(
 				op_node.type = NodeType::Minus;
 				break;
 			case NodeType::Multiply:
-				unary_prec += 3;
 				op_node.type = NodeType::GetAddress;
 				break;
 			case NodeType::StaticRun:
-				unary_prec -= 14 + 3;
 			case NodeType::Range:
 			case NodeType::ViewRange:
-				unary_prec += 3;
 			case NodeType::LogicNot:
 			case NodeType::BitNot:
 			case NodeType::Dereference:
@@ -141,49 +141,50 @@ Node parse_expression(
 			case NodeType::Double:
 			case NodeType::Character:
 			case NodeType::String:
-				sp::push_value(nodes, op_node);
+				priv__::place_expression_node(nodes, op_node, last, last);
 				goto Finish;
 			case NodeType::OpenPar:
-				sp::push_value(context, ParamInfo{op_node.pos, NodeType::ClosePar, false, false});
+				sp::push_value(context, ParamInfo{op_node.pos, operator_info(op_node.type).closer, false, false});
 				prec_offset += 32;
 				continue;
 			case NodeType::OpenBrace:
 				if (token->type == NodeType::CloseBrace){
 					op_node.type = NodeType::EmptyArray;
-					sp::push_value(nodes, op_node);
+					priv__::place_expression_node(nodes, op_node, last, last);
 					++token;
 					goto Finish;
 				}
-				sp::push_value(context, ParamInfo{sp::len(nodes), NodeType::CloseBrace, true, false});
+				sp::push_value(context, ParamInfo{last, operator_info(op_node.type).closer, true, false});
 				op_node.type = NodeType::ArrayLiteral;
 				op_node.data.size = 1;
 				prec_offset += 32;
 				break;
 			case NodeType::OpenBracket:
-				sp::push_value(context, ParamInfo{op_node.pos, NodeType::CloseBracket, false, true});
+				sp::push_value(context, ParamInfo{op_node.pos, operator_info(op_node.type).closer, false, true});
 				op_node.type = NodeType::FixedArray;
 				prec_offset += 32;
-				unary_prec += 4;
 				break;
 			case NodeType::FiniteArray:
-				sp::push_value(
-					context, ParamInfo{op_node.pos, NodeType::CloseDoubleBracket, false, true}
-				);
+				sp::push_value(context, ParamInfo{op_node.pos, operator_info(op_node.type).closer, false, true});
 				prec_offset += 32;
-				unary_prec += 4;
 				break;
-			case NodeType::Slice:
+			case NodeType::Slice: // only at the start of a subscript, before any node of its first element
 				[[unlikely]] if (
 					sp::back(context).finisher != NodeType::CloseBracket
 					|| sp::back(context).expects_value
+					|| priv__::expression_links[sp::back(context).index] != sp::len(priv__::expression_links)-1
+					|| priv__::expression_node(nodes, first, sp::back(context).index).type == NodeType::Slice
 				){
-					raise_error("invalid usage of the slice operator", op_node.pos);
+					raise_error(ErrorId::InvalidSlice, op_node.pos);
+					goto Error;
+				}
+				priv__::expression_node(nodes, first, sp::back(context).index).type = NodeType::Slice;
+				[[unlikely]] if (priv__::expression_node(nodes, first, sp::back(context).index).data.size != 1){
+					raise_error(ErrorId::CommasInSlice, op_node.pos);
+					goto Error;
 				}
-				nodes[sp::back(context).index].type = NodeType::Slice;
-				[[unlikely]] if (nodes[sp::back(context).index].data.size != 1)
-					raise_error("commas inside the slice expression", op_node.pos);
 				if (token->type == NodeType::CloseBracket){
-					nodes[sp::back(context).index].data.size = 3;
+					priv__::expression_node(nodes, first, sp::back(context).index).data.size = 3;
 					sp::pop(context);
 					++token;
 					prec_offset -= 32;
@@ -191,26 +192,23 @@ Node parse_expression(
 				}
 				continue;
 			default:
-				raise_error("missing value", op_node.pos);
-		}
-		sp::push_value(nodes, op_node);
-		if (sp::back(precs)[0] < unary_prec){
-			[[unlikely]] if (sp::is_full(precs))
-				raise_error("exceeded expression depth", op_node.pos);
-			sp::push_value(precs, (uint32_t [2]){unary_prec, end_pos});
+				raise_error(ErrorId::MissingValue, op_node.pos);
+				goto Error;
 		}
+		priv__::place_expression_node(nodes, op_node, last, last);
+		unary_prec += operator_info(op_node.type).prefix_prec;
+		if (sp::back(precs)[0] < unary_prec) sp::push_value(precs, (uint32_t [2]){unary_prec, end_pos});
 		continue;
 
 	Finish:
 		for (;;){
 			op_node = *token;
-			size_t encloser_index = (size_t)op_node.type - (size_t)NodeType::ClosePar;
-			if (encloser_index > sp::len(ClosingNameTable)) break;
+			if (!is_closing_token(op_node.type)) break;
 
 			if (sp::len(context) == 1) break;
 			[[unlikely]] if (op_node.type != sp::back(context).finisher){
 				// handle the case when two single brackets are closed with one double bracket
-				if (encloser_index == 3){
+				if (op_node.type == NodeType::CloseDoubleBracket){
 					if (
 						sp::back(context).finisher == NodeType::CloseBracket
 						&& sp::len(context)>1 && context[sp::len(context)-2].finisher==NodeType::CloseBracket
@@ -220,12 +218,17 @@ Node parse_expression(
 						goto BreakIf;
 					}
 				}
-				raise_error("too many closing ", ClosingNameTable[encloser_index], op_node.pos);
+				raise_error(too_many_closing_error(op_node.type), op_node.pos);
+				++token;
+				goto Error;
 			}
-			if (encloser_index==1 && nodes[sp::back(context).index].type==NodeType::ArrayLiteral){
+			if (
+				op_node.type==NodeType::CloseBrace
+				&& priv__::expression_node(nodes, first, sp::back(context).index).type==NodeType::ArrayLiteral
+			){
 				if ((token+1)->type == NodeType::Assign){
 					++token;
-					nodes[sp::back(context).index].type = NodeType::ExpandAssign;
+					priv__::expression_node(nodes, first, sp::back(context).index).type = NodeType::ExpandAssign;
 					op_node.type = NodeType::ExpandAssign;
 					sp::pop(context);
 					prec_offset -= 32;
@@ -236,6 +239,12 @@ Node parse_expression(
 			sp::pop(context);
 			prec_offset -= 32;
 			++token;
+			// operators inside a list or inside the size of an array type are closed with it,
+			// the ones inside parenthesis are kept, since they start where the parenthesis starts
+			if (sp::end(context)->is_list || sp::end(context)->expects_value){
+				while (sp::back(precs)[0] >= prec_offset+32) sp::pop(precs);
+				if (sp::end(context)->is_list) end_pos = sp::end(context)->index;
+			}
 			
 			if (sp::end(context)->expects_value) goto Continue;
 			op_node = *token;
@@ -243,18 +252,20 @@ Node parse_expression(
 	ExpandAssign:
 		++token;
 
-		size_t prec_index = (size_t)op_node.type - (size_t)NodeType::Comma;
-		if (prec_index >= sp::len(prec_table)) goto Return;
+		const OperatorInfo &info = operator_info(op_node.type);
+		if (!info.prec) goto Return;
 
-		uint32_t prec = prec_table[prec_index] + prec_offset;
+		uint32_t prec = info.prec + prec_offset;
+		uint32_t rtl = info.flags & OperatorRightToLeft;
 	
-		if (prec <= sp::back(precs)[0]){
+		if (op_node.type==NodeType::Comma || op_node.type==NodeType::Slice){
+			// every element of a list starts from the level of the list
+			while (sp::len(precs)>1 && sp::back(precs)[0]>=prec_offset) sp::pop(precs);
+		} else if (prec <= sp::back(precs)[0]){
 			while (prec <= precs[sp::len(precs)-2][0]) sp::pop(precs);
-			sp::back(precs)[0] = prec;
+			sp::back(precs)[0] = prec - rtl;
 		} else{
-			[[unlikely]] if (sp::is_full(precs))
-				raise_error("exceeded expression depth", op_node.pos);
-			sp::push_value(precs, (uint32_t [2]){prec-right_to_left(op_node.type), end_pos});
+			sp::push_value(precs, (uint32_t [2]){prec-rtl, end_pos});
 		}
 		
 		switch (op_node.type){
@@ -264,15 +275,12 @@ Node parse_expression(
 		case NodeType::GetProcedure:
 		case NodeType::GetSomethingInBraces:
 		case NodeType::GetField:{ // TO DO: handle unary postfix operators
-				NodeType finisher_type = (NodeType)((uint16_t)op_node.type + (
-					op_node.type < NodeType::GetProcedure
-					? ((uint16_t)NodeType::ClosePar - (uint16_t)NodeType::OpenPar)
-					: ((uint16_t)NodeType::ClosePar - (uint16_t)NodeType::GetProcedure)
-				));
+				NodeType finisher_type = info.closer;
 				bool has_arguments = token->type != finisher_type; 
 				op_node.data.size = has_arguments;	
 				if (!has_arguments){
-					sp::push_value(nodes, op_node);
+					priv__::place_expression_node(nodes, op_node, sp::back(precs)[1], last);
+					reordered = true;
 					++token;
 					goto Finish;
 				}
@@ -281,29 +289,33 @@ Node parse_expression(
 			} break;
 		case NodeType::Comma:
 			if (!sp::back(context).is_list) goto Return;
-			++nodes[(size_t)sp::back(context).index].data.size;
+			++priv__::expression_node(nodes, first, sp::back(context).index).data.size;
 			continue;
 		case NodeType::ExpandAssign:
 			continue;
 		case NodeType::Colon:
-			raise_error("not implemented", op_node.pos); // TO DO: implement ternary expression
+			raise_error(ErrorId::NotImplemented, op_node.pos); // TO DO: implement ternary expression
+			goto Error;
 		case NodeType::Slice:
 			[[unlikely]] if (
 				sp::back(context).finisher != NodeType::CloseBracket || sp::back(context).expects_value
 			){
-				raise_error("invalid usage of the slice operator", op_node.pos);
+				raise_error(ErrorId::InvalidSlice, op_node.pos);
+				goto Error;
+			}
+			[[unlikely]] if (priv__::expression_node(nodes, first, sp::back(context).index).data.size != 1){
+				raise_error(ErrorId::CommasInSlice, op_node.pos);
+				goto Error;
 			}
-			[[unlikely]] if (nodes[sp::back(context).index].data.size != 1)
-				raise_error("commas inside the slice expression", op_node.pos);
-			nodes[sp::back(context).index].type = NodeType::Slice;
+			priv__::expression_node(nodes, first, sp::back(context).index).type = NodeType::Slice;
 			if (token->type == NodeType::CloseBracket){
-				nodes[sp::back(context).index].data.size = 2;
+				priv__::expression_node(nodes, first, sp::back(context).index).data.size = 2;
 				sp::pop(context);
 				++token;
 				prec_offset -= 32;
 				goto Finish;
 			}
-			nodes[sp::back(context).index].data.size = 0;
+			priv__::expression_node(nodes, first, sp::back(context).index).data.size = 0;
 			continue;
 		case NodeType::Range: // TO DO: handle it
 			op_node.type = NodeType::Slice;
@@ -312,21 +324,33 @@ Node parse_expression(
 		default:
 			break;
 		}
-		insert(nodes, sp::back(precs)[1], op_node);
+		priv__::place_expression_node(nodes, op_node, sp::back(precs)[1], last);
+		reordered = true;
 	}
 Return:
-	{
-		size_t encloser_index = (size_t)op_node.type - (size_t)NodeType::ClosePar;
-		[[unlikely]] if (sp::len(context) != 1){
-			raise_error(
-				"unmatched pair of ",
-				ClosingNameTable[(size_t)sp::back(context).finisher - (size_t)NodeType::ClosePar],
-				sp::back(context).finisher!=NodeType::ClosePar | sp::back(context).is_list
-				? nodes[sp::back(context).index].pos
-				: sp::back(context).index
-			);
-		}
-		*token_iter = token;
-		return op_node;
+	[[unlikely]] if (sp::len(context) != 1){
+		raise_error(
+			unmatched_error(sp::back(context).finisher),
+			sp::back(context).is_list
+			? priv__::expression_node(nodes, first, sp::back(context).index).pos
+			: sp::back(context).index
+		);
+		goto Error;
 	}
+	if (reordered) priv__::order_expression_nodes(nodes, first);
+	sp::deinit(precs);
+	sp::deinit(context);
+	*token_iter = token;
+	return op_node;
+
+// op_node is the token at which the error was found, the token iterator is left after it,
+// the Error node is added too so the expression always has at least one node
+Error:
+	if (reordered) priv__::order_expression_nodes(nodes, first);
+	op_node.type = NodeType::Error;
+	sp::push_value(nodes, op_node);
+	sp::deinit(precs);
+	sp::deinit(context);
+	*token_iter = token;
+	return op_node;
 }
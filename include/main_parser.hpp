@@ -1,4 +1,6 @@
-#include "expr_parser.hpp"
+#pragma once
+
+#include "pratt_parser.hpp"
 
 struct FunctionModel{
 	uint32_t args = 0;
@@ -20,13 +22,16 @@ using LabelArrayType = sp::DynamicArray<LabelInfo, sp::MallocAllocator<>>;
 
 
 
-void parse_function(
+// returns index of the first node of the function's body, nodes before it are the parameters,
+// expressions are parsed with the engine, which gives the same output
+template<ExpressionEngine Engine = ExpressionEngine::PrecedenceStack, class TokenIter>
+uint32_t parse_function(
 	NodeArrayType &nodes,
 	LabelArrayType &labels,
-	const Node **token_iter
-) noexcept{ // returns last node
+	TokenIter *token_iter
+) noexcept{
 	size_t scope_count = 0;
-	const Node *token = *token_iter;
+	TokenIter token = *token_iter;
 	Node curr = *token;
 
 	FunctionModel model;
@@ -37,8 +42,10 @@ void parse_function(
 	token += model.is_inline;
 	model.args = sp::len(nodes);
 
-	[[unlikely]] if (token->type != NodeType::OpenPar)
-		raise_error("missing parenhessis for function's parameters", token->pos);
+	[[unlikely]] if (token->type != NodeType::OpenPar){
+		raise_error(ErrorId::MissingParameterParenthesis, token->pos);
+		goto RecoverParameters;
+	}
 	++token;
 	curr = *token;
 	++token;
@@ -46,8 +53,10 @@ void parse_function(
 
 	for (;;){ // parse parameters
 		++model.arg_count;
-		[[unlikely]] if (curr.type != NodeType::Name)
-			raise_error("missing function's parameter name", curr.pos);
+		[[unlikely]] if (curr.type != NodeType::Name){
+			raise_error(ErrorId::MissingParameterName, curr.pos);
+			goto RecoverParameters;
+		}
 		switch (token->type){
 		case NodeType::Colon:                // pass by value
 		case NodeType::DoubleColon:          // require constant parameter
@@ -58,29 +67,37 @@ void parse_function(
 			curr.type = token->type;	
 			break;
 		default:
-			raise_error("expected parameter specification symbol", token->pos);
+			raise_error(ErrorId::ExpectedParameterSpecification, token->pos);
+			goto RecoverParameters;
 		}
 		sp::push_value(nodes, curr);
 		++token;
 		size_t start_index = sp::len(nodes);
-		curr = parse_expression(nodes, &token);
-		if (nodes[start_index].type == NodeType::Assign)
-			raise_error("default arguments are not yet supported", nodes[start_index].pos);
+		curr = parse_expression_with<Engine>(nodes, &token);
+		if (nodes[start_index].type == NodeType::Assign){
+			raise_error(ErrorId::DefaultArguments, nodes[start_index].pos);
+			goto RecoverParameters;
+		}
 	 	
 		if (curr.type != NodeType::Comma) break;
 		curr = *token;
 		++token;
 	}
 	
-	if (curr.type != NodeType::ClosePar)
-		[[unlikely]] raise_error("missing closing parenthesis", curr.pos);
+	[[unlikely]] if (curr.type != NodeType::ClosePar){
+		if (curr.type != NodeType::Error) raise_error(ErrorId::MissingClosingParenthesis, curr.pos);
+	RecoverParameters: // skips to the function's body
+		while (token->type!=NodeType::OpenScope && token->type!=NodeType::Null) ++token;
+	}
 
 ParseReturnType:
-	if (token->type != NodeType::OpenScope)
-		[[unlikely]] raise_error("missing function's body", token->pos);
+	model.ast = sp::len(nodes);
+	[[unlikely]] if (token->type != NodeType::OpenScope){
+		raise_error(ErrorId::MissingFunctionBody, token->pos);
+		goto Return;
+	}
 	++token;
 
-	model.ast = sp::len(nodes);
 	model.labels = sp::len(labels);
 	for (;;){
 		curr = *token;
@@ -99,8 +116,10 @@ ParseReturnType:
 			case NodeType::If:
 
 			case NodeType::Greater:
-				if (token->type!=NodeType::Name || (token+1)->type!=NodeType::Greater)
-					raise_error("wrong label syntax", curr.pos);
+				if (token->type!=NodeType::Name || (token+1)->type!=NodeType::Greater){
+					raise_error(ErrorId::WrongLabelSyntax, curr.pos);
+					goto Recover;
+				}
 				sp::push_value(labels, LabelInfo{
 					token->data.index, (uint32_t)token->u16, sp::len(nodes)
 				});
@@ -111,31 +130,41 @@ ParseReturnType:
 				sp::push_value(nodes, curr);
 				goto ParseExpression;
 			case NodeType::Unset:
-				if (token->type != NodeType::Name)
-					raise_error("missing name of constant", token->pos);
+				if (token->type != NodeType::Name){
+					raise_error(ErrorId::MissingConstantName, token->pos);
+					goto Recover;
+				}
 				curr.data.index = token->data.index;
 				curr.u16 = token->u16;
 				++token;
-				if (token->type != NodeType::Terminator)
-					raise_error("missing semicolon", token->pos);
+				if (token->type != NodeType::Terminator){
+					raise_error(ErrorId::MissingSemicolon, token->pos);
+					goto Recover;
+				}
 				++token;
 				break;
 			case NodeType::StaticAssert:
 				sp::push_value(nodes, curr);
-				curr = parse_expression(nodes, &token);
+				curr = parse_expression_with<Engine>(nodes, &token);
 				if (curr.type == NodeType::Comma) goto ParseExpression;
-				[[unlikely]] if (curr.type != NodeType::Terminator)
-					raise_error("missing semicolon", token->pos);
+				[[unlikely]] if (curr.type != NodeType::Terminator){
+					if (curr.type != NodeType::Error) raise_error(ErrorId::MissingSemicolon, token->pos);
+					goto RecoverAtLastToken;
+				}
 				curr.type = NodeType::String;
-				curr.u16 = 0;
+				curr.u16 = StringInNames;
+				curr.data.u64 = 0;
 				break;
 			case NodeType::Asm:
 				// TO DO: implement it
-				raise_error("inline assembly is not yet implemented", curr.pos);
+				raise_error(ErrorId::InlineAssembly, curr.pos);
+				goto Recover;
 			case NodeType::Goto:
 				if (token->type != NodeType::Name){
-					[[unlikely]] if (token->type != NodeType::OpenPar)
-						raise_error("missing name of label after goto", curr.pos);
+					[[unlikely]] if (token->type != NodeType::OpenPar){
+						raise_error(ErrorId::MissingLabelName, curr.pos);
+						goto Recover;
+					}
 					curr.type = NodeType::GotoInstruction;
 					sp::push_value(nodes, curr);
 					goto ParseExpression;
@@ -143,18 +172,17 @@ ParseReturnType:
 				curr.data.index = token->data.index;
 				curr.u16 = token->u16;
 				++token;
-				[[unlikely]] if (token->type != NodeType::Terminator)
-					raise_error("missing semicolon", curr.pos);
+				[[unlikely]] if (token->type != NodeType::Terminator){
+					raise_error(ErrorId::MissingSemicolon, curr.pos);
+					goto Recover;
+				}
 				++token;
 				break;
 			case NodeType::Break:
 			case NodeType::Continue:
 				curr.data.size = 1;
 				if (token->type == NodeType::Name){
-					curr.type = (NodeType)(
-						(uint16_t)curr.type
-						+ ((uint16_t)NodeType::BreakIterator - (uint16_t)NodeType::Break)
-					);
+					curr.type = curr.type==NodeType::Break ? NodeType::BreakIterator : NodeType::ContinueIterator;
 					curr.data.index = token->data.index;
 					curr.u16 = token->u16;
 					++token;
@@ -162,15 +190,19 @@ ParseReturnType:
 					curr.data.size = token->data.u64;
 					++token;
 				}
-				[[unlikely]] if (token->type != NodeType::Terminator)
-					raise_error("missing semicolon", curr.pos);
+				[[unlikely]] if (token->type != NodeType::Terminator){
+					raise_error(ErrorId::MissingSemicolon, curr.pos);
+					goto Recover;
+				}
 				++token;
 				break;
 			case NodeType::Return:
 				sp::push_value(nodes, curr);
-				curr = parse_expression(nodes, &token);
-				[[unlikely]] if (curr.type != NodeType::Terminator)
-					raise_error("missing semicolon", curr.pos);
+				curr = parse_expression_with<Engine>(nodes, &token);
+				[[unlikely]] if (curr.type != NodeType::Terminator){
+					if (curr.type != NodeType::Error) raise_error(ErrorId::MissingSemicolon, curr.pos);
+					goto RecoverAtLastToken;
+				}
 				continue;
 			case NodeType::Name:
 				switch (token->type){
@@ -183,8 +215,10 @@ ParseReturnType:
 						
 						for (;;){
 							++token;
-							if (token->type != NodeType::Name)
-								raise_error("missing variable name", token->pos);
+							if (token->type != NodeType::Name){
+								raise_error(ErrorId::MissingVariableName, token->pos);
+								goto Recover;
+							}
 							sp::push_value(nodes, *token);
 							++token;
 
@@ -198,7 +232,8 @@ ParseReturnType:
 								++token;
 								goto ParseExpression;
 							default:
-								raise_error("expected declaration symbol", token->pos);
+								raise_error(ErrorId::ExpectedDeclarationSymbol, token->pos);
+								goto Recover;
 							}
 						}
 					}
@@ -217,27 +252,53 @@ ParseReturnType:
 			ParseExpression:
 				{
 					size_t start_index = sp::len(nodes);
-					curr = parse_expression(nodes, &token);
+					curr = parse_expression_with<Engine>(nodes, &token);
 					if (curr.type != NodeType::Terminator){
 						[[unlikely]] if (
 							nodes[start_index].type != NodeType::ArrayLiteral
 							|| (curr.type!=NodeType::Variable && curr.type!=NodeType::Constant)
-						) raise_error("missing semicolon", curr.pos);
-						
+						){
+							if (curr.type != NodeType::Error) raise_error(ErrorId::MissingSemicolon, curr.pos);
+							goto RecoverAtLastToken;
+						}
 						curr.data.size = nodes[start_index].data.size;
-						curr.type = (NodeType)((uint16_t)curr.type + 2);
+						curr.type = curr.type==NodeType::Variable ? NodeType::ExpandedVariable : NodeType::ExpandedConstant;
 						nodes[start_index] = curr;
-						curr = parse_expression(nodes, &token);
-						[[unlikely]] if (curr.type != NodeType::Terminator)
-							raise_error("missing semicolon", curr.pos);
+						curr = parse_expression_with<Engine>(nodes, &token);
+						[[unlikely]] if (curr.type != NodeType::Terminator){
+							if (curr.type != NodeType::Error) raise_error(ErrorId::MissingSemicolon, curr.pos);
+							goto RecoverAtLastToken;
+						}
 					}
 					continue;
 				}
 		}
 		sp::push_value(nodes, curr);
+		continue;
+
+	// the rest of the statement is skipped, up to the semicolon or the closing brace of the scope,
+	// nodes that were already added for it are left as they are
+	RecoverAtLastToken:
+		--token;
+	Recover:
+		for (size_t depth=0;; ++token){
+			NodeType type = token->type;
+			if (type==NodeType::OpenBrace || type==NodeType::OpenScope){
+				++depth;
+			} else if (type == NodeType::CloseBrace){
+				if (!depth) break;
+				--depth;
+			} else if (type==NodeType::Terminator && !depth){
+				++token;
+				break;
+			} else if (type == NodeType::Null){
+				goto Return;
+			}
+		}
 	}
 Return:
 	curr.type = NodeType::Terminator;
 	sp::push_value(nodes, curr);
 	*token_iter = token;
+	return model.ast;
 }
@@ -0,0 +1,353 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <bit>
+
+#include "SPL/Utils.hpp"
+#include "power_of_five.hpp"
+
+// Parsing of numeric literals without the C library.
+// Integers are read 8 digits at a time: the digits are validated and converted to their values
+// inside a 64 bit word, then combined with three multiplications (the first character is the
+// lowest byte, so it ends up as the most significant digit).
+// Floating point literals are converted with the Eisel-Lemire algorithm, which is correctly
+// rounded and gives the same bits as strtod. Literals that have more than 19 significant digits
+// and lie too close to a halfway point are handed to strtod.
+
+namespace priv__{
+	constexpr uint64_t SwarOnes = 0x0101010101010101;
+	constexpr uint64_t SwarHighBits = 0x8080808080808080;
+	constexpr size_t MinPageSize = 4096;
+
+	struct DigitTableType{
+		SP_CI uint8_t operator [](char c) const noexcept{ return data[(uint8_t)c]; }
+
+		uint8_t data[256];
+	};
+
+	SP_CSI DigitTableType make_digit_table() noexcept{
+		DigitTableType table{};
+		for (uint8_t &value : table.data) value = 0xff;
+		for (uint32_t c='0'; c<='9'; ++c) table.data[c] = c - '0';
+		for (uint32_t c='a'; c<='f'; ++c) table.data[c] = c - 'a' + 10;
+		for (uint32_t c='A'; c<='F'; ++c) table.data[c] = c - 'A' + 10;
+		return table;
+	}
+
+	constexpr DigitTableType DigitValue = make_digit_table();
+
+	// sets the highest bit of every byte from the range [first, last]
+	// bytes bigger than 127 are never selected, but they can corrupt bytes that come after them
+	SP_CSI uint64_t swar_bytes_in_range(uint64_t word, uint8_t first, uint8_t last) noexcept{
+		return ~(word | (word + SwarOnes*(127-last))) & (word + SwarOnes*(128-first)) & SwarHighBits;
+	}
+
+	SP_CSI uint64_t swar_digit_mask(uint64_t word, uint32_t base) noexcept{
+		if (base == 16){
+			return (
+				swar_bytes_in_range(word, '0', '9')
+				| swar_bytes_in_range(word, 'a', 'f') | swar_bytes_in_range(word, 'A', 'F')
+			);
+		}
+		return swar_bytes_in_range(word, '0', '0' + base - 1);
+	}
+
+	SP_CSI uint64_t swar_digit_values(uint64_t word, uint32_t base) noexcept{
+		if (base == 16) return (word & 0x0f0f0f0f0f0f0f0f) + 9*((word >> 6) & SwarOnes);
+		return word - SwarOnes*'0';
+	}
+
+	// combines 8 digit values into a number, the result always fits into 32 bits
+	SP_CSI uint64_t swar_combine_digits(uint64_t digits, uint64_t base) noexcept{
+		digits = ((digits & 0x0f0f0f0f0f0f0f0f) * (base*256 + 1)) >> 8;
+		digits = ((digits & 0x00ff00ff00ff00ff) * (base*base*65536 + 1)) >> 16;
+		return ((digits & 0x0000ffff0000ffff) * ((base*base*base*base << 32) + 1)) >> 32;
+	}
+
+	// reads at most 8 digits, returns their count
+	inline uint32_t read_digit_chunk(const char *input, uint32_t base, uint64_t *chunk) noexcept{
+		if constexpr (std::endian::native == std::endian::little){
+			// the load cannot cross a page boundary, otherwise it could touch unmapped memory
+			if (((uintptr_t)input & (MinPageSize-1)) <= MinPageSize-8){
+				uint64_t word;
+				__builtin_memcpy(&word, input, 8);
+				uint64_t invalid = ~swar_digit_mask(word, base) & SwarHighBits;
+				uint32_t count = invalid ? std::countr_zero(invalid) / 8 : 8;
+				if (count){
+					uint64_t digits = swar_digit_values(word, base) << 8*(8-count);
+					*chunk = swar_combine_digits(digits, base);
+				}
+				return count;
+			}
+		}
+		uint64_t value = 0;
+		uint32_t count = 0;
+		for (; count!=8 && DigitValue[input[count]]<base; ++count)
+			value = value*base + DigitValue[input[count]];
+		*chunk = value;
+		return count;
+	}
+} // END OF NAMESPACE PRIV //////////
+
+
+// parses digits of an integer in the given base, single quotes between the digits are skipped
+// returns true if the value does not fit into 64 bits
+bool parse_integer(const char **inpIter, uint32_t base, uint64_t *result) noexcept{
+	uint64_t powers[9] = {1};
+	for (size_t i=1; i!=9; ++i) powers[i] = powers[i-1] * base;
+
+	const char *input = *inpIter;
+	uint64_t value = 0;
+	bool overflow = false;
+	for (;;){
+		uint64_t chunk;
+		uint32_t count = priv__::read_digit_chunk(input, base, &chunk);
+		if (count){
+			overflow |= __builtin_mul_overflow(value, powers[count], &value);
+			overflow |= __builtin_add_overflow(value, chunk, &value);
+			input += count;
+			if (count == 8) continue;
+		}
+		if (input != *inpIter && input[0] == '\'' && priv__::DigitValue[input[1]] < base){
+			++input;
+			continue;
+		}
+		break;
+	}
+	*inpIter = input;
+	*result = value;
+	return overflow;
+}
+
+
+
+
+// DECIMAL FLOATING POINT LITERALS
+// value of the literal is mantissa * 10^exponent, truncated means that some nonzero digits
+// did not fit into the mantissa
+struct DecimalNumber{
+	uint64_t mantissa;
+	int64_t exponent;
+	bool truncated;
+};
+
+// mantissas up to this value can take one more digit without overflowing
+constexpr uint64_t MaxDecimalMantissa = 999999999999999999;
+
+namespace priv__{
+	SP_CSI bool is_digit(char c) noexcept{ return (uint8_t)(c-'0') < 10; }
+
+	// reads a run of decimal digits with separators, every digit that is stored in the mantissa
+	// adds fraction_step to the exponent and every dropped one adds 1 + fraction_step
+	inline const char *read_decimal_digits(
+		const char *input, DecimalNumber *number, int64_t fraction_step
+	) noexcept{
+		const char *first = input;
+		for (;;){
+			while (number->mantissa < 100000000000){
+				uint64_t chunk;
+				uint32_t count = read_digit_chunk(input, 10, &chunk);
+				if (!count) break;
+				uint64_t scale = 1;
+				for (uint32_t i=0; i!=count; ++i) scale *= 10;
+				number->mantissa = number->mantissa*scale + chunk;
+				number->exponent += fraction_step*count;
+				input += count;
+				if (count != 8) goto Separator;
+			}
+			for (; is_digit(*input); ++input){
+				if (number->mantissa <= MaxDecimalMantissa){
+					number->mantissa = number->mantissa*10 + (*input - '0');
+					number->exponent += fraction_step;
+				} else{
+					number->truncated |= *input != '0';
+					number->exponent += 1 + fraction_step;
+				}
+			}
+		Separator:
+			if (input != first && input[0] == '\'' && is_digit(input[1])){
+				++input;
+				continue;
+			}
+			return input;
+		}
+	}
+} // END OF NAMESPACE PRIV //////////
+
+
+// continues parsing of a literal from the decimal point, which must be followed by a digit
+void parse_decimal_fraction(const char **inpIter, DecimalNumber *number) noexcept{
+	const char *input = priv__::read_decimal_digits(*inpIter+1, number, -1);
+
+	if ((*input=='e' || *input=='E')){
+		const char *exp_iter = input + 1;
+		bool negative = *exp_iter == '-';
+		exp_iter += *exp_iter=='-' || *exp_iter=='+';
+		if (priv__::is_digit(*exp_iter)){
+			int64_t exponent = 0;
+			for (; priv__::is_digit(*exp_iter); ++exp_iter)
+				if (exponent < 0x10000) exponent = exponent*10 + (*exp_iter - '0');
+			number->exponent += negative ? -exponent : exponent;
+			input = exp_iter;
+		}
+	}
+	*inpIter = input;
+}
+
+// parses whole literal, the integer part can be empty
+DecimalNumber parse_decimal(const char **inpIter) noexcept{
+	DecimalNumber number{0, 0, false};
+	*inpIter = priv__::read_decimal_digits(*inpIter, &number, 0);
+	parse_decimal_fraction(inpIter, &number);
+	return number;
+}
+
+
+
+namespace priv__{
+	template<class F> struct FloatFormat;
+
+	template<> struct FloatFormat<double>{
+		typedef uint64_t Bits;
+		constexpr static int32_t MantissaBits = 52;
+		constexpr static int32_t MinExponent = -1023;
+		constexpr static int32_t InfinitePower = 0x7ff;
+		constexpr static int64_t SmallestPowerOfTen = -342;
+		constexpr static int64_t LargestPowerOfTen = 308;
+		constexpr static int64_t MinRoundToEven = -4;
+		constexpr static int64_t MaxRoundToEven = 23;
+		constexpr static int64_t MaxFastExponent = 22;
+		constexpr static uint64_t MaxFastMantissa = (uint64_t)1 << 53;
+		constexpr static double FastPowers[] = {
+			1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+		};
+	};
+
+	template<> struct FloatFormat<float>{
+		typedef uint32_t Bits;
+		constexpr static int32_t MantissaBits = 23;
+		constexpr static int32_t MinExponent = -127;
+		constexpr static int32_t InfinitePower = 0xff;
+		constexpr static int64_t SmallestPowerOfTen = -65;
+		constexpr static int64_t LargestPowerOfTen = 38;
+		constexpr static int64_t MinRoundToEven = -17;
+		constexpr static int64_t MaxRoundToEven = 10;
+		constexpr static int64_t MaxFastExponent = 10;
+		constexpr static uint64_t MaxFastMantissa = (uint64_t)1 << 24;
+		constexpr static float FastPowers[] = {
+			1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+		};
+	};
+
+	struct AdjustedMantissa{
+		uint64_t mantissa;
+		int32_t power2;
+
+		SP_CI bool operator ==(const AdjustedMantissa &) const noexcept = default;
+	};
+
+	// floor(log2(10^q)) + 63
+	SP_CSI int32_t binary_power(int32_t q) noexcept{ return (((152170 + 65536) * q) >> 16) + 63; }
+
+	// computes the value of w * 10^q rounded to the nearest float of the given format
+	template<class F>
+	SP_CSI AdjustedMantissa compute_float(int64_t q, uint64_t w) noexcept{
+		typedef FloatFormat<F> Format;
+
+		if (w == 0 || q < Format::SmallestPowerOfTen) return AdjustedMantissa{0, 0};
+		if (q > Format::LargestPowerOfTen) return AdjustedMantissa{0, Format::InfinitePower};
+
+		int32_t lz = std::countl_zero(w);
+		w <<= lz;
+
+		// product with the truncated power of five, second word is only needed when
+		// the bits below the mantissa are all ones
+		constexpr uint64_t PrecisionMask = UINT64_MAX >> (Format::MantissaBits + 3);
+		size_t index = 2 * (size_t)(q - SmallestPowerOfFive);
+		unsigned __int128 first = (unsigned __int128)w * PowerOfFive128[index];
+		uint64_t high = first >> 64;
+		uint64_t low = (uint64_t)first;
+		if ((high & PrecisionMask) == PrecisionMask){
+			uint64_t second = ((unsigned __int128)w * PowerOfFive128[index+1]) >> 64;
+			low += second;
+			high += second > low;
+		}
+
+		int32_t upperbit = high >> 63;
+		int32_t shift = upperbit + 64 - Format::MantissaBits - 3;
+		AdjustedMantissa answer;
+		answer.mantissa = high >> shift;
+		answer.power2 = binary_power((int32_t)q) + upperbit - lz - Format::MinExponent;
+
+		if (answer.power2 <= 0){ // subnormal
+			if (-answer.power2 + 1 >= 64) return AdjustedMantissa{0, 0};
+			answer.mantissa >>= -answer.power2 + 1;
+			answer.mantissa += answer.mantissa & 1;
+			answer.mantissa >>= 1;
+			answer.power2 = answer.mantissa < ((uint64_t)1 << Format::MantissaBits) ? 0 : 1;
+			return answer;
+		}
+
+		// exact halfway cases are rounded to even
+		if (
+			low <= 1 && q >= Format::MinRoundToEven && q <= Format::MaxRoundToEven
+			&& (answer.mantissa & 3) == 1 && (answer.mantissa << shift) == high
+		) answer.mantissa &= ~(uint64_t)1;
+
+		answer.mantissa += answer.mantissa & 1;
+		answer.mantissa >>= 1;
+		if (answer.mantissa >= ((uint64_t)2 << Format::MantissaBits)){
+			answer.mantissa = (uint64_t)1 << Format::MantissaBits;
+			++answer.power2;
+		}
+		answer.mantissa &= ~((uint64_t)1 << Format::MantissaBits);
+		if (answer.power2 >= Format::InfinitePower) return AdjustedMantissa{0, Format::InfinitePower};
+		return answer;
+	}
+
+	template<class F>
+	F slow_decimal_to_float(const char *first, const char *last) noexcept{
+		char buffer[128];
+		char *text = last-first < (ptrdiff_t)sizeof(buffer) ? buffer : (char *)malloc(last-first+1);
+		char *J = text;
+		for (const char *I=first; I!=last; ++I) if (*I != '\'') *J++ = *I;
+		*J = '\0';
+
+		F result;
+		if constexpr (std::is_same_v<F, float>)
+			result = strtof(text, nullptr);
+		else
+			result = strtod(text, nullptr);
+		if (text != buffer) ::free(text);
+		return result;
+	}
+} // END OF NAMESPACE PRIV //////////
+
+
+// converts a parsed literal to a float or a double, [first, last) is the text of the literal,
+// it is used only by the fallback for literals with too many digits
+template<class F>
+F decimal_to_float(DecimalNumber number, const char *first, const char *last) noexcept{
+	typedef priv__::FloatFormat<F> Format;
+
+	if (
+		!number.truncated && number.mantissa <= Format::MaxFastMantissa
+		&& number.exponent >= -Format::MaxFastExponent && number.exponent <= Format::MaxFastExponent
+	){
+		F value = (F)number.mantissa;
+		if (number.exponent < 0) return value / Format::FastPowers[-number.exponent];
+		return value * Format::FastPowers[number.exponent];
+	}
+
+	priv__::AdjustedMantissa am = priv__::compute_float<F>(number.exponent, number.mantissa);
+	[[unlikely]] if (
+		number.truncated
+		&& am != priv__::compute_float<F>(number.exponent, number.mantissa + 1)
+	) return priv__::slow_decimal_to_float<F>(first, last);
+
+	return std::bit_cast<F>(
+		(typename Format::Bits)(am.mantissa | (uint64_t)am.power2 << Format::MantissaBits)
+	);
+}
@@ -0,0 +1,258 @@
+#pragma once
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "tokenizer.hpp"
+
+// Text is split at newlines and every part is tokenized by its own thread, as if no comment
+// or string literal was open at its start. Afterwards parts are checked in order: a part is valid
+// if the tokenizer of the previous part stopped exactly at its first token. Invalid parts are
+// tokenized again as a continuation of the previous one, so the result is always the same
+// as the one of the serial make_tokens.
+
+constexpr size_t ParallelTokensMinChunk = (size_t)256 << 10;
+
+struct NameTables{
+	sp::DynamicArray<char, sp::MallocAllocator<>> names;
+	sp::DynamicArray<Symbol, sp::MallocAllocator<>> symbols;
+	sp::DynamicArray<uint32_t, sp::MallocAllocator<>> symbol_slots;
+};
+
+// exchanges name tables of the current thread with the given ones
+void swap_name_tables(NameTables &tables) noexcept{
+	sp::swap(names, tables.names);
+	sp::swap(symbols, tables.symbols);
+	sp::swap(symbol_slots, tables.symbol_slots);
+}
+
+// names of the chunk that starts at the offset or after it are moved back by the shift
+struct NameShift{
+	uint32_t offset;
+	uint32_t shift;
+};
+
+struct TokenChunk{
+	TokenizerState lexer;
+	NameTables tables;
+	const char *text;
+	const char *begin;
+	const char *limit; // nullptr for the last chunk
+	const char *stop;  // position where the tokenizer stopped
+	bool failed;
+
+	// placement inside the results
+	sp::DynamicArray<uint32_t, sp::MallocAllocator<>> symbol_map; // local symbol id -> symbol id
+	sp::DynamicArray<NameShift, sp::MallocAllocator<>> name_shifts;
+	uint32_t names_offset;
+	Node *output;
+};
+
+
+namespace priv__{
+
+inline void lex_token_chunk(TokenChunk &chunk) noexcept{
+	if (chunk.limit)
+		chunk.stop = lex_tokens<true>(chunk.lexer, chunk.stop, chunk.limit);
+	else
+		chunk.stop = lex_tokens<false>(chunk.lexer, chunk.stop, nullptr);
+}
+
+void *lex_token_chunk_speculatively(void *arg) noexcept{
+	TokenChunk &chunk = *(TokenChunk *)arg;
+	swap_name_tables(chunk.tables);
+	jmp_buf jump;
+	error_jump = &jump;
+	if (setjmp(jump)){
+		chunk.failed = true;
+	} else{
+		chunk.lexer.curr.pos = chunk.begin - chunk.text;
+		chunk.stop = chunk.begin;
+		lex_token_chunk(chunk);
+	}
+	error_jump = nullptr;
+	swap_name_tables(chunk.tables);
+	return nullptr;
+}
+
+// continues tokenization of the chunk with its own name tables on the current thread
+inline void extend_token_chunk(TokenChunk &chunk, const char *limit) noexcept{
+	chunk.limit = limit;
+	swap_name_tables(chunk.tables);
+	lex_token_chunk(chunk);
+	swap_name_tables(chunk.tables);
+}
+
+inline void free_token_chunk(TokenChunk &chunk) noexcept{
+	sp::deinit(chunk.lexer.tokens);
+	sp::deinit(chunk.lexer.outer_closes);
+	sp::deinit(chunk.tables.names);
+	sp::deinit(chunk.tables.symbols);
+	sp::deinit(chunk.tables.symbol_slots);
+	sp::deinit(chunk.symbol_map);
+	sp::deinit(chunk.name_shifts);
+}
+
+// adds names and strings of the chunk to the tables of the current thread, in the same order
+// as the serial tokenizer would do it, local names consist of strings and first appearances
+// of symbols, so strings are everything between the symbols
+inline void place_chunk_names(TokenChunk &chunk) noexcept{
+	const char *local_names = sp::beg(chunk.tables.names);
+	sp::resize(chunk.symbol_map, sp::len(chunk.tables.symbols));
+	chunk.names_offset = sp::len(names);
+
+	uint32_t position = 0;
+	uint32_t shift = 0;
+	for (uint32_t id=0; id!=sp::len(chunk.tables.symbols); ++id){
+		const Symbol &symbol = chunk.tables.symbols[id];
+		sp::push_range(names, sp::Range<const char>{local_names+position, symbol.offset-position});
+
+		size_t prev_len = sp::len(names);
+		chunk.symbol_map[id] = intern_name(
+			sp::Range<const char>{local_names+symbol.offset, symbol.len}, symbol.hash
+		);
+		position = symbol.offset + symbol.len;
+		if (sp::len(names) == prev_len){ // symbol was already known
+			shift += symbol.len;
+			sp::push_value(chunk.name_shifts, NameShift{position, shift});
+		}
+	}
+	sp::push_range(
+		names, sp::Range<const char>{local_names+position, sp::len(chunk.tables.names)-position}
+	);
+}
+
+void *copy_chunk_tokens(void *arg) noexcept{
+	TokenChunk &chunk = *(TokenChunk *)arg;
+	const NameShift *shift_iter = sp::beg(chunk.name_shifts);
+	uint32_t shift = 0;
+
+	Node *output = chunk.output;
+	for (const Node *it=sp::beg(chunk.lexer.tokens); it!=sp::end(chunk.lexer.tokens); ++it, ++output){
+		*output = *it;
+		if (it->type == NodeType::Name){
+			output->data.index = chunk.symbol_map[it->data.index];
+		} else if (it->type==NodeType::String && it->u16==StringInNames){
+			uint32_t index = it->data.u32_array[0];
+			for (; shift_iter!=sp::end(chunk.name_shifts) && shift_iter->offset<=index; ++shift_iter)
+				shift = shift_iter->shift;
+			output->data.u32_array[0] = chunk.names_offset + index - shift;
+		}
+	}
+	return nullptr;
+}
+
+// runs the procedure for every chunk on a separate thread,
+// if a thread cannot be created the procedure is called on the current one
+void run_for_chunks(void *(*proc)(void *), sp::Range<TokenChunk> chunks) noexcept{
+	sp::DynamicArray<pthread_t, sp::MallocAllocator<>> threads;
+	sp::resize(threads, chunks.size);
+	sp::DynamicArray<bool, sp::MallocAllocator<>> started;
+	sp::resize(started, chunks.size);
+	for (size_t i=0; i!=chunks.size; ++i){
+		started[i] = !pthread_create(&threads[i], nullptr, proc, chunks.ptr+i);
+		[[unlikely]] if (!started[i]) proc(chunks.ptr+i);
+	}
+	for (size_t i=0; i!=chunks.size; ++i)
+		if (started[i]) pthread_join(threads[i], nullptr);
+	sp::deinit(threads);
+	sp::deinit(started);
+}
+
+} // END OF NAMESPACE priv__
+
+
+sp::DynamicArray<Node, sp::MallocAllocator<>> make_tokens(
+	const char *input, size_t size, size_t thread_count
+) noexcept{
+	if (thread_count == 0) thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t chunk_count = size / ParallelTokensMinChunk;
+	if (chunk_count > thread_count) chunk_count = thread_count;
+	if (chunk_count < 2) return make_tokens(input);
+
+	sp::DynamicArray<TokenChunk, sp::MallocAllocator<>> chunks;
+	const char *begin = input;
+	for (size_t i=1; i<=chunk_count && begin; ++i){
+		const char *limit = nullptr;
+		if (i != chunk_count){
+			const char *target = input + size/chunk_count*i;
+			if (target <= begin) continue;
+			limit = (const char *)memchr(target, '\n', input+size-target);
+			if (limit) ++limit;
+		}
+		sp::push_value(chunks, TokenChunk{});
+		sp::back(chunks).text = input;
+		sp::back(chunks).begin = begin;
+		sp::back(chunks).limit = limit;
+		begin = limit;
+	}
+	priv__::run_for_chunks(
+		priv__::lex_token_chunk_speculatively, sp::Range<TokenChunk>{sp::beg(chunks), sp::len(chunks)}
+	);
+
+	// validation of the starting states, invalid chunks are merged into the previous ones
+	if (chunks[0].failed){
+		priv__::free_token_chunk(chunks[0]);
+		chunks[0].lexer = TokenizerState{};
+		chunks[0].tables = NameTables{};
+		chunks[0].stop = chunks[0].begin;
+		priv__::extend_token_chunk(chunks[0], chunks[0].limit);
+	}
+	size_t last = 0;
+	for (size_t i=1; i!=sp::len(chunks); ++i){
+		TokenChunk &prev = chunks[last];
+		if (!prev.lexer.finished){
+			if (!chunks[i].failed && prev.stop == skip_blanks(chunks[i].begin)){
+				chunks[++last] = chunks[i];
+				continue;
+			}
+			priv__::extend_token_chunk(prev, chunks[i].limit);
+		}
+		priv__::free_token_chunk(chunks[i]);
+	}
+	sp::resize(chunks, last+1);
+
+	// names are placed serially, but only once for every chunk,
+	// braces that are closed or terminated in later chunks are resolved here too
+	size_t token_count = 0;
+	for (size_t i=0; i!=sp::len(chunks); ++i) token_count += sp::len(chunks[i].lexer.tokens);
+	sp::DynamicArray<Node, sp::MallocAllocator<>> tokens;
+	sp::resize(tokens, token_count);
+
+	sp::DynamicArray<uint32_t, sp::MallocAllocator<>> scopes;
+	sp::DynamicArray<uint32_t, sp::MallocAllocator<>> resolved_scopes;
+	token_count = 0;
+	for (size_t i=0; i!=sp::len(chunks); ++i){
+		TokenChunk &chunk = chunks[i];
+		priv__::place_chunk_names(chunk);
+		chunk.output = sp::beg(tokens) + token_count;
+
+		for (size_t j=0; j!=sp::len(chunk.lexer.outer_closes); ++j){
+			if (sp::is_empty(scopes)) break;
+			if (chunk.lexer.outer_closes[j] && sp::back(scopes) != ResolvedScope)
+				sp::push_value(resolved_scopes, sp::back(scopes));
+			sp::pop(scopes);
+		}
+		if (chunk.lexer.outer_terminated && !sp::is_empty(scopes) && sp::back(scopes) != ResolvedScope){
+			sp::push_value(resolved_scopes, sp::back(scopes));
+			sp::back(scopes) = ResolvedScope;
+		}
+		for (size_t j=0; j!=sp::len(chunk.lexer.scopes); ++j){
+			uint32_t scope = chunk.lexer.scopes[j];
+			sp::push_value(scopes, scope == ResolvedScope ? scope : scope+(uint32_t)token_count);
+		}
+		token_count += sp::len(chunk.lexer.tokens);
+	}
+
+	priv__::run_for_chunks(
+		priv__::copy_chunk_tokens, sp::Range<TokenChunk>{sp::beg(chunks), sp::len(chunks)}
+	);
+	for (size_t i=0; i!=sp::len(resolved_scopes); ++i)
+		tokens[resolved_scopes[i]].type = NodeType::OpenScope;
+
+	for (size_t i=0; i!=sp::len(chunks); ++i) priv__::free_token_chunk(chunks[i]);
+	sp::deinit(chunks);
+	sp::deinit(scopes);
+	sp::deinit(resolved_scopes);
+	return tokens;
+}
@@ -0,0 +1,305 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "main_parser.hpp"
+
+// Tokens, name tables and the output of parse_function stored on disk for a source text.
+// A cache file is found by a hash of the text and the parser version. It starts with a header
+// followed by aligned sections, which are used in place after the file is mapped.
+// Files are written to a temporary file that is renamed, so readers never see a partial file.
+// The format is native, caches are not meant to be moved between different machines.
+
+// has to be changed whenever the tokens, the nodes or the format of the cache change
+constexpr uint32_t ParserVersion = 6;
+
+constexpr char ParseCacheMagic[8] = {'S', 'P', 'P', 'C', 'A', 'C', 'H', 'E'};
+constexpr size_t ParseCacheAlignment = 64;
+
+struct ParseCacheSection{
+	uint64_t offset; // from the start of the file
+	uint64_t count;
+};
+
+struct ParseCacheHeader{
+	char magic[8];
+	uint32_t version;
+	uint16_t node_size;
+	uint16_t node_type_count;
+	uint64_t key;
+	uint64_t text_size;
+
+	ParseCacheSection tokens;
+	ParseCacheSection names;
+	ParseCacheSection symbols;
+	ParseCacheSection nodes;
+	ParseCacheSection labels;
+};
+
+// tokens can be empty when the text was lexed lazily
+struct ParseCacheData{
+	sp::Range<const Node> tokens;
+	sp::Range<const char> names;
+	sp::Range<const Symbol> symbols;
+	sp::Range<const Node> nodes;
+	sp::Range<const LabelInfo> labels;
+};
+
+struct ParseCache{
+	ParseCacheData data;
+	void *mapping = nullptr;
+	size_t mapped_size = 0;
+};
+
+
+
+// CONTENT HASH
+// 64 bit hash with the structure of xxHash64, 32 bytes are hashed in 4 independent lanes
+namespace priv__{
+
+constexpr uint64_t HashPrime1 = 0x9e3779b185ebca87;
+constexpr uint64_t HashPrime2 = 0xc2b2ae3d27d4eb4f;
+constexpr uint64_t HashPrime3 = 0x165667b19e3779f9;
+constexpr uint64_t HashPrime4 = 0x85ebca77c2b2ae63;
+constexpr uint64_t HashPrime5 = 0x27d4eb2f165667c5;
+
+SP_CSI uint64_t hash_round(uint64_t acc, uint64_t input) noexcept{
+	acc += input * HashPrime2;
+	acc = acc<<31 | acc>>33;
+	return acc * HashPrime1;
+}
+
+SP_CSI uint64_t hash_merge(uint64_t acc, uint64_t lane) noexcept{
+	acc ^= hash_round(0, lane);
+	return acc*HashPrime1 + HashPrime4;
+}
+
+SP_CSI uint64_t rotate_left(uint64_t x, int bits) noexcept{ return x<<bits | x>>(64-bits); }
+
+inline uint64_t load_u64(const char *text) noexcept{
+	uint64_t word;
+	__builtin_memcpy(&word, text, 8);
+	return word;
+}
+
+} // END OF NAMESPACE priv__
+
+inline uint64_t hash_text(const char *text, size_t size, uint64_t seed) noexcept{
+	using namespace priv__;
+	const char *end = text + size;
+	uint64_t hash;
+	if (size >= 32){
+		uint64_t lanes[4] = {seed+HashPrime1+HashPrime2, seed+HashPrime2, seed, seed-HashPrime1};
+		for (; end-text>=32; text+=32)
+			for (int i=0; i!=4; ++i) lanes[i] = hash_round(lanes[i], load_u64(text + 8*i));
+		hash = (
+			rotate_left(lanes[0], 1) + rotate_left(lanes[1], 7)
+			+ rotate_left(lanes[2], 12) + rotate_left(lanes[3], 18)
+		);
+		for (int i=0; i!=4; ++i) hash = hash_merge(hash, lanes[i]);
+	} else{
+		hash = seed + HashPrime5;
+	}
+	hash += size;
+
+	for (; end-text>=8; text+=8){
+		hash ^= hash_round(0, load_u64(text));
+		hash = rotate_left(hash, 27)*HashPrime1 + HashPrime4;
+	}
+	if (end-text >= 4){
+		uint32_t word;
+		__builtin_memcpy(&word, text, 4);
+		hash ^= word * HashPrime1;
+		hash = rotate_left(hash, 23)*HashPrime2 + HashPrime3;
+		text += 4;
+	}
+	for (; text!=end; ++text){
+		hash ^= (uint8_t)*text * HashPrime5;
+		hash = rotate_left(hash, 11) * HashPrime1;
+	}
+
+	hash ^= hash >> 33;
+	hash *= HashPrime2;
+	hash ^= hash >> 29;
+	hash *= HashPrime3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+// the parser version is the seed, so caches of older versions are never found
+inline uint64_t parse_cache_key(const char *text, size_t size) noexcept{
+	return hash_text(text, size, ParserVersion);
+}
+
+// returns false if the path does not fit into the buffer
+inline bool make_parse_cache_path(char *buffer, size_t capacity, const char *dir, uint64_t key) noexcept{
+	int len = snprintf(buffer, capacity, "%s/%016lx.spc", dir, (unsigned long)key);
+	return len>0 && (size_t)len<capacity;
+}
+
+
+
+// WRITING
+namespace priv__{
+
+SP_CSI uint64_t align_cache_offset(uint64_t offset) noexcept{
+	return (offset + ParseCacheAlignment - 1) & ~(uint64_t)(ParseCacheAlignment - 1);
+}
+
+inline bool write_all(int fd, const void *data, size_t size) noexcept{
+	const char *it = (const char *)data;
+	while (size){
+		ssize_t count = write(fd, it, size);
+		[[unlikely]] if (count < 0){
+			if (errno == EINTR) continue;
+			return false;
+		}
+		it += count;
+		size -= count;
+	}
+	return true;
+}
+
+// padding is written up to the offset of the section
+inline bool write_cache_section(
+	int fd, uint64_t &position, ParseCacheSection section, const void *data, size_t size
+) noexcept{
+	static const char zeros[ParseCacheAlignment] = {};
+	if (!write_all(fd, zeros, section.offset-position)) return false;
+	position = section.offset + size;
+	return write_all(fd, data, size);
+}
+
+} // END OF NAMESPACE priv__
+
+bool write_parse_cache(const char *path, uint64_t key, size_t text_size, const ParseCacheData &data) noexcept{
+	ParseCacheHeader header{};
+	memcpy(header.magic, ParseCacheMagic, sizeof(header.magic));
+	header.version = ParserVersion;
+	header.node_size = sizeof(Node);
+	header.node_type_count = (uint16_t)NodeTypeCount;
+	header.key = key;
+	header.text_size = text_size;
+
+	uint64_t offset = sizeof(ParseCacheHeader);
+	auto place = [&](ParseCacheSection &section, size_t count, size_t element_size) noexcept{
+		section.offset = priv__::align_cache_offset(offset);
+		section.count = count;
+		offset = section.offset + count*element_size;
+	};
+	place(header.tokens, data.tokens.size, sizeof(Node));
+	place(header.names, data.names.size, sizeof(char));
+	place(header.symbols, data.symbols.size, sizeof(Symbol));
+	place(header.nodes, data.nodes.size, sizeof(Node));
+	place(header.labels, data.labels.size, sizeof(LabelInfo));
+
+	size_t path_len = strlen(path);
+	char *temp_path = (char *)malloc(path_len + 8);
+	if (!temp_path) return false;
+	memcpy(temp_path, path, path_len);
+	memcpy(temp_path+path_len, ".XXXXXX", 8);
+	int fd = mkstemp(temp_path);
+	[[unlikely]] if (fd < 0){
+		::free(temp_path);
+		return false;
+	}
+
+	uint64_t position = sizeof(ParseCacheHeader);
+	bool written = (
+		priv__::write_all(fd, &header, sizeof(header))
+		&& priv__::write_cache_section(fd, position, header.tokens, data.tokens.ptr, data.tokens.size*sizeof(Node))
+		&& priv__::write_cache_section(fd, position, header.names, data.names.ptr, data.names.size)
+		&& priv__::write_cache_section(
+			fd, position, header.symbols, data.symbols.ptr, data.symbols.size*sizeof(Symbol)
+		)
+		&& priv__::write_cache_section(fd, position, header.nodes, data.nodes.ptr, data.nodes.size*sizeof(Node))
+		&& priv__::write_cache_section(
+			fd, position, header.labels, data.labels.ptr, data.labels.size*sizeof(LabelInfo)
+		)
+	);
+	written = written && !fsync(fd); // contents are on the disk before the file gets its name
+	written &= !close(fd);
+	written = written && !rename(temp_path, path);
+	if (!written) unlink(temp_path);
+	::free(temp_path);
+	return written;
+}
+
+
+
+// LOADING
+namespace priv__{
+
+template<class T>
+inline bool map_cache_section(
+	sp::Range<const T> &range, ParseCacheSection section, const char *file, size_t file_size
+) noexcept{
+	if (section.offset % ParseCacheAlignment || section.offset > file_size) return false;
+	if (section.count > (file_size-section.offset) / sizeof(T)) return false;
+	range = sp::Range<const T>{(const T *)(file + section.offset), section.count};
+	return true;
+}
+
+} // END OF NAMESPACE priv__
+
+// returns false if there is no valid cache for the text at the path
+bool load_parse_cache(ParseCache &cache, const char *path, uint64_t key, size_t text_size) noexcept{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return false;
+	struct stat info;
+	if (fstat(fd, &info) || (size_t)info.st_size < sizeof(ParseCacheHeader)){
+		close(fd);
+		return false;
+	}
+	size_t size = info.st_size;
+	void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED) return false;
+
+	const char *file = (const char *)mapping;
+	const ParseCacheHeader &header = *(const ParseCacheHeader *)file;
+	ParseCacheData data;
+	bool valid = (
+		!memcmp(header.magic, ParseCacheMagic, sizeof(header.magic))
+		&& header.version == ParserVersion
+		&& header.node_size == sizeof(Node)
+		&& header.node_type_count == (uint16_t)NodeTypeCount
+		&& header.key == key && header.text_size == text_size
+		&& priv__::map_cache_section(data.tokens, header.tokens, file, size)
+		&& priv__::map_cache_section(data.names, header.names, file, size)
+		&& priv__::map_cache_section(data.symbols, header.symbols, file, size)
+		&& priv__::map_cache_section(data.nodes, header.nodes, file, size)
+		&& priv__::map_cache_section(data.labels, header.labels, file, size)
+	);
+	if (!valid){
+		munmap(mapping, size);
+		return false;
+	}
+	cache.data = data;
+	cache.mapping = mapping;
+	cache.mapped_size = size;
+	return true;
+}
+
+void free_parse_cache(ParseCache &cache) noexcept{
+	if (cache.mapping) munmap(cache.mapping, cache.mapped_size);
+	cache = ParseCache{};
+}
+
+// name tokens and nodes refer to the cached name tables, so they replace the ones of the thread,
+// the hash table of symbols is rebuilt when the next name is interned
+void use_cached_names(const ParseCache &cache) noexcept{
+	sp::resize(names, 0);
+	sp::push_range(names, cache.data.names);
+	sp::resize(symbols, 0);
+	sp::push_range(symbols, cache.data.symbols);
+	sp::resize(symbol_slots, 0);
+}
@@ -0,0 +1,296 @@
+#pragma once
+
+#include "expr_parser.hpp"
+
+// Second engine for expressions, a Pratt parser that gives the same output as parse_expression.
+// Operators bind with the powers of OperatorTable, the right operand of an operator is parsed with
+// its power, one lower for the right to left ones, and it ends at the first operator that does not
+// bind stronger. Operand of a prefix operator is parsed with the power of the operator, unless
+// the operand of the operator around it is parsed with a higher one. Brackets are parsed by recursion,
+// so powers are not raised for each level of brackets, and lists and separators are handled by
+// the bracket that is parsed. Nodes are placed with the links of parse_expression.
+
+// nesting of operands that is parsed before ExpressionDepth is reported
+constexpr uint32_t PrattDepthLimit = 4096;
+
+namespace priv__{
+
+enum class PrattStatus : uint8_t{
+	Parsed,      // the next token is not consumed
+	Closed,      // the bracket was closed while its content was parsed
+	ClosedOuter, // the bracket and the one around it were closed with a double bracket
+	Expand,      // the array literal is the left side of an expanding assignment
+	Stopped,     // the expression ended or an error was found
+};
+
+// the outermost one stands for the whole expression
+struct PrattBracket{
+	const PrattBracket *outer;
+	ParamInfo info;
+};
+
+template<class TokenIter>
+struct PrattParser{
+	NodeArrayType &nodes;
+	TokenIter token;
+	size_t first;
+	uint32_t last = 0; // slot of the last node in the output
+	uint32_t depth = 0;
+	bool reordered = false;
+	bool failed = false;
+	Node end; // token that ended the expression or at which the error was found
+};
+
+template<class TokenIter>
+PrattStatus parse_pratt_level(PrattParser<TokenIter> &p, const PrattBracket &bracket, uint32_t min_power) noexcept;
+
+template<class TokenIter>
+PrattStatus stop_pratt(PrattParser<TokenIter> &p, ErrorId error, uint32_t pos, const Node &token) noexcept{
+	raise_error(error, pos);
+	p.end = token;
+	p.failed = true;
+	return PrattStatus::Stopped;
+}
+
+// the token ends the expression, which is an error inside of brackets
+template<class TokenIter>
+PrattStatus end_pratt(PrattParser<TokenIter> &p, const PrattBracket &bracket, const Node &token) noexcept{
+	if (!bracket.outer){
+		p.end = token;
+		return PrattStatus::Stopped;
+	}
+	return stop_pratt(
+		p, unmatched_error(bracket.info.finisher),
+		bracket.info.is_list ? expression_node(p.nodes, p.first, bracket.info.index).pos : bracket.info.index, token
+	);
+}
+
+// elements separated by commas and slices, it stops at the closing token
+template<class TokenIter>
+PrattStatus parse_pratt_elements(PrattParser<TokenIter> &p, const PrattBracket &bracket) noexcept{
+	const ParamInfo &info = bracket.info;
+	bool is_subscript = info.is_list && info.finisher==NodeType::CloseBracket;
+	if (is_subscript && p.token->type==NodeType::Slice){ // slice without the lower bound
+		++p.token;
+		Node &list = expression_node(p.nodes, p.first, info.index);
+		list.type = NodeType::Slice;
+		if (p.token->type == NodeType::CloseBracket){
+			list.data.size = 3;
+			++p.token;
+			return PrattStatus::Closed;
+		}
+	}
+
+	for (;;){
+		PrattStatus status = parse_pratt_level(p, bracket, 0);
+		if (status == PrattStatus::ClosedOuter) return PrattStatus::Closed;
+		if (status != PrattStatus::Parsed) return status;
+
+		Node token = *p.token;
+		if (token.type == NodeType::Comma){
+			++p.token;
+			if (!info.is_list) return end_pratt(p, bracket, token);
+			++expression_node(p.nodes, p.first, info.index).data.size;
+		} else if (token.type == NodeType::Slice){
+			++p.token;
+			[[unlikely]] if (!is_subscript) return stop_pratt(p, ErrorId::InvalidSlice, token.pos, token);
+			Node &list = expression_node(p.nodes, p.first, info.index);
+			[[unlikely]] if (list.data.size != 1) return stop_pratt(p, ErrorId::CommasInSlice, token.pos, token);
+			list.type = NodeType::Slice;
+			if (p.token->type == NodeType::CloseBracket){
+				list.data.size = 2;
+				++p.token;
+				return PrattStatus::Closed;
+			}
+			list.data.size = 0;
+		} else{
+			return PrattStatus::Parsed;
+		}
+	}
+}
+
+template<class TokenIter>
+PrattStatus parse_pratt_bracket(PrattParser<TokenIter> &p, const PrattBracket &bracket) noexcept{
+	PrattStatus status = parse_pratt_elements(p, bracket);
+	if (status == PrattStatus::Closed) return PrattStatus::Parsed;
+	if (status != PrattStatus::Parsed) return status;
+
+	Node token = *p.token;
+	++p.token;
+	if (!is_closing_token(token.type)) return end_pratt(p, bracket, token);
+	[[unlikely]] if (token.type != bracket.info.finisher){
+		// two single brackets are closed with one double bracket
+		if (
+			token.type==NodeType::CloseDoubleBracket && bracket.info.finisher==NodeType::CloseBracket
+			&& bracket.outer->info.finisher==NodeType::CloseBracket
+		) return PrattStatus::ClosedOuter;
+		return stop_pratt(p, too_many_closing_error(token.type), token.pos, token);
+	}
+	if (
+		token.type==NodeType::CloseBrace && p.token->type==NodeType::Assign
+		&& expression_node(p.nodes, p.first, bracket.info.index).type==NodeType::ArrayLiteral
+	){
+		expression_node(p.nodes, p.first, bracket.info.index).type = NodeType::ExpandAssign;
+		++p.token;
+		return PrattStatus::Expand;
+	}
+	return PrattStatus::Parsed;
+}
+
+// an operand with its prefix operators
+template<class TokenIter>
+PrattStatus parse_pratt_operand(PrattParser<TokenIter> &p, const PrattBracket &bracket, uint32_t min_power) noexcept{
+	Node op_node = *p.token;
+	++p.token;
+
+	switch (op_node.type){
+	case NodeType::Add:
+		op_node.type = NodeType::Plus;
+		break;
+	case NodeType::Subtract:
+		op_node.type = NodeType::Minus;
+		break;
+	case NodeType::Multiply:
+		op_node.type = NodeType::GetAddress;
+		break;
+	case NodeType::StaticRun:
+	case NodeType::Range:
+	case NodeType::ViewRange:
+	case NodeType::LogicNot:
+	case NodeType::BitNot:
+	case NodeType::Dereference:
+	case NodeType::StaticSize:
+	case NodeType::StaticLen:
+	case NodeType::Inline:
+		break;
+	case NodeType::Name:
+	case NodeType::Integer:
+	case NodeType::Unsigned:
+	case NodeType::Float:
+	case NodeType::Double:
+	case NodeType::Character:
+	case NodeType::String:
+		place_expression_node(p.nodes, op_node, p.last, p.last);
+		return PrattStatus::Parsed;
+	case NodeType::OpenPar:
+		return parse_pratt_bracket(
+			p, PrattBracket{&bracket, ParamInfo{op_node.pos, operator_info(op_node.type).closer, false, false}}
+		);
+	case NodeType::OpenBrace:{
+			if (p.token->type == NodeType::CloseBrace){
+				op_node.type = NodeType::EmptyArray;
+				place_expression_node(p.nodes, op_node, p.last, p.last);
+				++p.token;
+				return PrattStatus::Parsed;
+			}
+			uint32_t place = p.last;
+			op_node.type = NodeType::ArrayLiteral;
+			op_node.data.size = 1;
+			place_expression_node(p.nodes, op_node, p.last, p.last);
+			PrattStatus status = parse_pratt_bracket(
+				p, PrattBracket{&bracket, ParamInfo{place, operator_info(NodeType::OpenBrace).closer, true, false}}
+			);
+			if (status != PrattStatus::Expand) return status;
+			return parse_pratt_level(
+				p, bracket, operator_info(NodeType::ExpandAssign).prec - right_to_left(NodeType::ExpandAssign)
+			);
+		}
+	case NodeType::OpenBracket:
+	case NodeType::FiniteArray:{ // size of the array type and then the type of its elements
+			NodeType finisher = operator_info(op_node.type).closer;
+			if (op_node.type == NodeType::OpenBracket) op_node.type = NodeType::FixedArray;
+			place_expression_node(p.nodes, op_node, p.last, p.last);
+			PrattStatus status = parse_pratt_bracket(
+				p, PrattBracket{&bracket, ParamInfo{op_node.pos, finisher, false, true}}
+			);
+			if (status != PrattStatus::Parsed) return status;
+			uint32_t power = operator_info(op_node.type).prefix_prec;
+			return parse_pratt_level(p, bracket, min_power>power ? min_power : power);
+		}
+	case NodeType::Slice:
+		return stop_pratt(p, ErrorId::InvalidSlice, op_node.pos, op_node);
+	default:
+		return stop_pratt(p, ErrorId::MissingValue, op_node.pos, op_node);
+	}
+	place_expression_node(p.nodes, op_node, p.last, p.last);
+	uint32_t power = operator_info(op_node.type).prefix_prec;
+	return parse_pratt_level(p, bracket, min_power>power ? min_power : power);
+}
+
+// an operand and the operators that bind to it stronger than the minimal power
+template<class TokenIter>
+PrattStatus parse_pratt_level(PrattParser<TokenIter> &p, const PrattBracket &bracket, uint32_t min_power) noexcept{
+	[[unlikely]] if (p.depth == PrattDepthLimit){
+		Node token = *p.token;
+		++p.token;
+		return stop_pratt(p, ErrorId::ExpressionDepth, token.pos, token);
+	}
+	++p.depth;
+	uint32_t start = p.last; // place of the left operand
+	PrattStatus status = parse_pratt_operand(p, bracket, min_power);
+
+	while (status == PrattStatus::Parsed){
+		Node op_node = *p.token;
+		const OperatorInfo &info = operator_info(op_node.type);
+		uint32_t power = info.prec;
+		if (power<=min_power || op_node.type==NodeType::Comma || op_node.type==NodeType::Slice) break;
+		++p.token;
+
+		p.reordered = true;
+		if (info.closer != NodeType::Null){
+			NodeType finisher = info.closer;
+			bool has_arguments = p.token->type != finisher;
+			op_node.data.size = has_arguments;
+			place_expression_node(p.nodes, op_node, start, p.last);
+			if (!has_arguments){
+				++p.token;
+				continue;
+			}
+			status = parse_pratt_bracket(p, PrattBracket{&bracket, ParamInfo{start, finisher, true, false}});
+			continue;
+		}
+		place_expression_node(p.nodes, op_node, start, p.last);
+		status = parse_pratt_level(p, bracket, power - (info.flags & OperatorRightToLeft));
+	}
+	--p.depth;
+	return status;
+}
+
+} // END OF NAMESPACE priv__
+
+// same as parse_expression
+template<class TokenIter>
+Node parse_expression_pratt(
+	NodeArrayType &nodes,
+	TokenIter *token_iter
+) noexcept{ // returns last node
+	using namespace priv__;
+	PrattParser<TokenIter> p{nodes, *token_iter, sp::len(nodes)};
+	sp::resize(expression_links, 1);
+	expression_links[0] = 0;
+
+	PrattBracket whole{nullptr, ParamInfo{0, NodeType(0), false, false}};
+	if (parse_pratt_elements(p, whole) == PrattStatus::Parsed){
+		p.end = *p.token;
+		++p.token;
+	}
+
+	if (p.reordered) order_expression_nodes(nodes, p.first);
+	if (p.failed){
+		p.end.type = NodeType::Error;
+		sp::push_value(nodes, p.end);
+	}
+	*token_iter = p.token;
+	return p.end;
+}
+
+enum class ExpressionEngine : uint8_t{
+	PrecedenceStack, // parse_expression
+	Pratt,           // parse_expression_pratt
+};
+
+template<ExpressionEngine Engine, class TokenIter>
+Node parse_expression_with(NodeArrayType &nodes, TokenIter *token_iter) noexcept{
+	if constexpr (Engine == ExpressionEngine::Pratt) return parse_expression_pratt(nodes, token_iter);
+	else return parse_expression(nodes, token_iter);
+}
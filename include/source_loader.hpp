@@ -0,0 +1,106 @@
+#pragma once
+
+#include <stdlib.h>
+#include <errno.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// source text is always followed by at least one '\0' byte, which is the sentinel
+// that the tokenizer expects at the end of the input
+struct SourceText{
+	const char *ptr = nullptr;
+	size_t size = 0;        // length of the text without the sentinel
+	size_t mapped_size = 0; // 0 means that the buffer comes from malloc
+};
+
+constexpr size_t SourceReadChunk = (size_t)1 << 20;
+
+
+
+// reads the whole stream with large read calls, used for pipes, terminals and as a fallback
+SourceText read_source(int fd) noexcept{
+	SourceText src;
+	size_t capacity = SourceReadChunk;
+	char *buffer = (char *)malloc(capacity);
+	if (!buffer) return src;
+
+	size_t size = 0;
+	for (;;){
+		if (capacity - size < SourceReadChunk/4 + 1){
+			capacity *= 2;
+			char *new_buffer = (char *)realloc(buffer, capacity);
+			[[unlikely]] if (!new_buffer){
+				::free(buffer);
+				return src;
+			}
+			buffer = new_buffer;
+		}
+		ssize_t count = read(fd, buffer+size, capacity-size-1);
+		if (count == 0) break;
+		[[unlikely]] if (count < 0){
+			if (errno == EINTR) continue;
+			::free(buffer);
+			return src;
+		}
+		size += count;
+	}
+	buffer[size] = '\0';
+
+	src.ptr = buffer;
+	src.size = size;
+	return src;
+}
+
+
+// maps regular files read-only, if the size of the file is a multiple of the page size
+// an additional zeroed page is mapped after it to serve as the sentinel
+SourceText load_source(int fd) noexcept{
+	struct stat info;
+	if (fstat(fd, &info) || !S_ISREG(info.st_mode) || info.st_size == 0) return read_source(fd);
+
+	size_t size = info.st_size;
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	size_t mapped_size = (size/page_size + 1) * page_size;
+
+	int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+	flags |= MAP_POPULATE;
+#endif
+
+	void *region = mmap(nullptr, mapped_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (region == MAP_FAILED) return read_source(fd);
+
+	void *text = mmap(region, size, PROT_READ, flags | MAP_FIXED, fd, 0);
+	[[unlikely]] if (text == MAP_FAILED){
+		munmap(region, mapped_size);
+		return read_source(fd);
+	}
+	madvise(text, size, MADV_SEQUENTIAL);
+	madvise(text, size, MADV_WILLNEED);
+
+	SourceText src;
+	src.ptr = (const char *)text;
+	src.size = size;
+	src.mapped_size = mapped_size;
+	return src;
+}
+
+SourceText load_source(const char *path) noexcept{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return SourceText{};
+	SourceText src = load_source(fd);
+	close(fd);
+	return src;
+}
+
+
+void free_source(SourceText &src) noexcept{
+	if (src.mapped_size)
+		munmap((void *)src.ptr, src.mapped_size);
+	else
+		::free((void *)src.ptr);
+	src = SourceText{};
+}
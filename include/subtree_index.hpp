@@ -0,0 +1,128 @@
+#pragma once
+
+#include "main_parser.hpp"
+
+// Extent and parent of every node in the prefix ordered output of parse_function.
+// Subtree of a node ends at ends[index], so it is skipped with index = ends[index]
+// and its children are visited with:
+//   for (uint32_t child=index+1; child!=ends[index]; child=ends[child])
+// Statements and parameters of the function are roots, they have no parent.
+// The index is built with one pass from the back, children of a node are the subtrees
+// that follow it, their number is given by the type of the node and by its data.size.
+
+constexpr uint32_t NoParent = UINT32_MAX;
+
+struct SubtreeIndex{
+	sp::DynamicArray<uint32_t, sp::MallocAllocator<>> ends;    // index after the last node of the subtree
+	sp::DynamicArray<uint32_t, sp::MallocAllocator<>> parents; // NoParent for roots
+};
+
+
+SP_CSI size_t expression_arity(const Node &node) noexcept{
+	if (node.type == NodeType::Slice) // both bounds, upper bound, lower bound, none of them
+		return 3 - (node.data.size+1)/2;
+	const OperatorInfo &info = operator_info(node.type);
+	return info.arity + (info.flags&OperatorSizedArity ? node.data.size : 0);
+}
+
+// nodes added by parse_function itself
+SP_CSI size_t statement_arity(const Node &node) noexcept{
+	switch (node.type){
+	case NodeType::Colon:
+	case NodeType::DoubleColon:
+	case NodeType::Variable:
+	case NodeType::Constant:
+		return node.data.size + 2; // names and the value or the type
+	case NodeType::ExpandedVariable:
+	case NodeType::ExpandedConstant:
+		return node.data.size + 1;
+	case NodeType::StaticAssert:
+		return 2; // message is an empty string if it is missing
+	case NodeType::Set:
+	case NodeType::Return:
+	case NodeType::GotoInstruction:
+		return 1;
+	case NodeType::OpenScope:
+	case NodeType::CloseBrace:
+	case NodeType::Unset:
+	case NodeType::Goto:
+	case NodeType::Break:
+	case NodeType::Continue:
+	case NodeType::BreakIterator:
+	case NodeType::ContinueIterator:
+	case NodeType::Terminator:
+		return 0;
+	default:
+		return expression_arity(node);
+	}
+}
+
+
+namespace priv__{
+
+template<size_t (*arity_of)(const Node &)>
+void index_subtree_range(
+	uint32_t *ends, uint32_t *parents, sp::DynamicArray<uint32_t, sp::MallocAllocator<>> &roots,
+	const Node *nodes, size_t first, size_t last
+) noexcept{
+	for (size_t i=last; i--!=first;){
+		size_t arity = arity_of(nodes[i]);
+		uint32_t end = i + 1;
+		for (; arity && !sp::is_empty(roots); --arity){
+			uint32_t child = sp::pop_val(roots);
+			parents[child] = i;
+			end = ends[child];
+		}
+		ends[i] = end;
+		parents[i] = NoParent;
+		sp::push_value(roots, (uint32_t)i);
+	}
+}
+
+// end of the expression that starts at the index
+inline size_t find_expression_end(const Node *nodes, size_t index, size_t last) noexcept{
+	for (size_t needed=1; needed && index!=last; ++index) needed += expression_arity(nodes[index]) - 1;
+	return index;
+}
+
+} // END OF NAMESPACE priv__
+
+// nodes must be the output of parse_function and body the index that it returned,
+// after an error the missing children are left out
+void index_subtrees(SubtreeIndex &index, sp::Range<const Node> nodes, size_t body) noexcept{
+	sp::resize(index.ends, nodes.size);
+	sp::resize(index.parents, nodes.size);
+	uint32_t *ends = sp::beg(index.ends);
+	uint32_t *parents = sp::beg(index.parents);
+
+	// roots of the subtrees that follow the current node, the nearest one on the top
+	sp::DynamicArray<uint32_t, sp::MallocAllocator<>> roots;
+	priv__::index_subtree_range<statement_arity>(ends, parents, roots, nodes.ptr, body, nodes.size);
+
+	// parameter has the same type as some statements, but its only child is its type
+	sp::DynamicArray<uint32_t, sp::MallocAllocator<>> parameters;
+	for (size_t i=0; i<body; i=priv__::find_expression_end(nodes.ptr, i+1, body))
+		sp::push_value(parameters, (uint32_t)i);
+	size_t last = body;
+	while (!sp::is_empty(parameters)){
+		size_t parameter = sp::pop_val(parameters);
+		priv__::index_subtree_range<expression_arity>(ends, parents, roots, nodes.ptr, parameter+1, last);
+		uint32_t end = parameter + 1;
+		if (parameter+1 != last){
+			uint32_t child = sp::pop_val(roots);
+			parents[child] = parameter;
+			end = ends[child];
+		}
+		ends[parameter] = end;
+		parents[parameter] = NoParent;
+		sp::push_value(roots, (uint32_t)parameter);
+		last = parameter;
+	}
+	sp::deinit(parameters);
+	sp::deinit(roots);
+}
+
+void deinit(SubtreeIndex &index) noexcept{
+	sp::deinit(index.ends);
+	sp::deinit(index.parents);
+}
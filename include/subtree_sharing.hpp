@@ -0,0 +1,218 @@
+#pragma once
+
+#include "subtree_index.hpp"
+
+// Identical subtrees of a function body are stored once. The body is read once from the front
+// and compacted in place, every finished subtree gets a structural hash and when an identical
+// subtree was already written, it is replaced by a single SharedSubtree node that refers to
+// the index of the first copy. Copies are compared by the types and values of their nodes,
+// positions are not compared, the reference keeps the position of the subtree that it replaced.
+// A reference is a leaf for expression_arity, so the subtree index and the other passes treat
+// it as a single operand, and results computed for the first copy can be reused for it.
+// Single nodes are not shared, since the reference would not be smaller.
+
+namespace priv__{
+
+SP_CSI uint64_t mix_subtree_hash(uint64_t hash, uint64_t word) noexcept{
+	hash = (hash ^ word) * 0xff51afd7ed558ccd;
+	return hash ^ hash>>32;
+}
+
+// types for which data.size gives the number of children
+SP_CSI bool arity_uses_size(NodeType type) noexcept{
+	return operator_info(type).flags&OperatorSizedArity || type==NodeType::Slice;
+}
+
+// only the fields that have a meaning for the type, the others can hold anything
+inline uint64_t node_value_hash(const Node &node) noexcept{
+	uint64_t hash = mix_subtree_hash(0, (uint64_t)node.type);
+	switch (node.type){
+	case NodeType::Integer:
+	case NodeType::Unsigned:
+	case NodeType::Double:
+	case NodeType::Character:
+		return mix_subtree_hash(hash, node.data.u64);
+	case NodeType::Float:
+		return mix_subtree_hash(hash, node.data.u32_array[0]);
+	case NodeType::String:{
+			sp::Range<const char> text = string_text(node, code_text);
+			return mix_subtree_hash(hash, hash_name(text.ptr, text.size));
+		}
+	case NodeType::Name:
+		return mix_subtree_hash(hash, node.data.index);
+	default:
+		return arity_uses_size(node.type) ? mix_subtree_hash(hash, node.data.size) : hash;
+	}
+}
+
+inline bool same_node_value(const Node &lhs, const Node &rhs) noexcept{
+	if (lhs.type != rhs.type) return false;
+	switch (lhs.type){
+	case NodeType::Integer:
+	case NodeType::Unsigned:
+	case NodeType::Double:
+	case NodeType::Character:
+		return lhs.data.u64 == rhs.data.u64;
+	case NodeType::Float:
+		return lhs.data.u32_array[0] == rhs.data.u32_array[0];
+	case NodeType::String:{
+			sp::Range<const char> lhs_text = string_text(lhs, code_text);
+			sp::Range<const char> rhs_text = string_text(rhs, code_text);
+			return lhs_text.size==rhs_text.size && !__builtin_memcmp(lhs_text.ptr, rhs_text.ptr, lhs_text.size);
+		}
+	case NodeType::Name:
+		return lhs.data.index == rhs.data.index;
+	default:
+		return !arity_uses_size(lhs.type) || lhs.data.size==rhs.data.size;
+	}
+}
+
+// state of the pass, indices are positions in the compacted output
+struct SubtreeSharing{
+	const Node *nodes;
+	uint32_t *ends;    // index after the last node of a subtree that starts at the index
+	uint64_t *hashes;  // structural hash of a subtree that starts at the index
+	sp::DynamicArray<uint32_t, sp::MallocAllocator<>> table; // first copies + 1, 0 means empty
+	size_t count = 0;
+};
+
+// a child is identified by its first copy, different single nodes can still have the same value
+inline bool same_child(const SubtreeSharing &sharing, uint32_t lhs, uint32_t rhs) noexcept{
+	const Node *nodes = sharing.nodes;
+	if (nodes[lhs].type == NodeType::SharedSubtree) lhs = nodes[lhs].data.index;
+	if (nodes[rhs].type == NodeType::SharedSubtree) rhs = nodes[rhs].data.index;
+	if (lhs == rhs) return true;
+	return (
+		sharing.ends[lhs]==lhs+1 && sharing.ends[rhs]==rhs+1
+		&& same_node_value(nodes[lhs], nodes[rhs])
+	);
+}
+
+inline bool same_subtree(const SubtreeSharing &sharing, uint32_t lhs, uint32_t rhs, size_t arity) noexcept{
+	if (sharing.hashes[lhs]!=sharing.hashes[rhs] || !same_node_value(sharing.nodes[lhs], sharing.nodes[rhs]))
+		return false;
+	for (++lhs, ++rhs; arity; --arity){
+		if (!same_child(sharing, lhs, rhs)) return false;
+		lhs = sharing.ends[lhs];
+		rhs = sharing.ends[rhs];
+	}
+	return true;
+}
+
+inline void grow_sharing_table(SubtreeSharing &sharing) noexcept{
+	size_t slot_count = sp::len(sharing.table) ? 2*sp::len(sharing.table) : 1024;
+	sp::DynamicArray<uint32_t, sp::MallocAllocator<>> table;
+	sp::resize(table, slot_count);
+	for (size_t i=0; i!=slot_count; ++i) table[i] = 0;
+
+	size_t mask = slot_count - 1;
+	for (size_t j=0; j!=sp::len(sharing.table); ++j){
+		uint32_t entry = sharing.table[j];
+		if (!entry) continue;
+		size_t i = sharing.hashes[entry-1] & mask;
+		while (table[i]) i = (i + 1) & mask;
+		table[i] = entry;
+	}
+	sp::deinit(sharing.table);
+	sharing.table = table;
+}
+
+// returns the first copy of the subtree, which is the subtree itself if it was not found
+inline uint32_t find_first_copy(SubtreeSharing &sharing, uint32_t index, size_t arity) noexcept{
+	[[unlikely]] if (2*sharing.count >= sp::len(sharing.table)) grow_sharing_table(sharing);
+
+	size_t mask = sp::len(sharing.table) - 1;
+	for (size_t i=sharing.hashes[index]&mask;; i=(i+1)&mask){
+		uint32_t entry = sharing.table[i];
+		if (!entry){
+			sharing.table[i] = index + 1;
+			++sharing.count;
+			return index;
+		}
+		if (same_subtree(sharing, entry-1, index, arity)) return entry - 1;
+	}
+}
+
+struct SharingFrame{
+	uint32_t out;       // index of the root in the output
+	uint32_t remaining; // children that were not read yet
+	uint64_t hash;
+};
+
+} // END OF NAMESPACE priv__
+
+
+
+// nodes must be the output of parse_function and body the index that it returned,
+// indices of the labels are moved with the statements, returns the number of removed nodes
+size_t share_subtrees(NodeArrayType &nodes, LabelArrayType &labels, size_t body) noexcept{
+	using namespace priv__;
+	Node *ptr = sp::beg(nodes);
+	size_t size = sp::len(nodes);
+
+	sp::DynamicArray<uint32_t, sp::MallocAllocator<>> ends;
+	sp::DynamicArray<uint64_t, sp::MallocAllocator<>> hashes;
+	sp::resize(ends, size);
+	sp::resize(hashes, size);
+	SubtreeSharing sharing;
+	sharing.nodes = ptr;
+	sharing.ends = sp::beg(ends);
+	sharing.hashes = sp::beg(hashes);
+	sp::SmallArray<SharingFrame, 32, sp::MallocAllocator<>> frames;
+
+	LabelInfo *label = sp::beg(labels);
+	LabelInfo *labels_end = sp::end(labels);
+	while (label!=labels_end && label->index<body) ++label;
+
+	size_t out = body;
+	for (size_t i=body; i!=size; ++i){
+		for (; label!=labels_end && label->index==i; ++label) label->index = out;
+
+		Node node = ptr[i];
+		ptr[out] = node;
+		size_t arity = statement_arity(node);
+		uint64_t hash = node_value_hash(node);
+		++out;
+		if (arity){
+			sp::push_value(frames, SharingFrame{(uint32_t)out-1, (uint32_t)arity, hash});
+			continue;
+		}
+		uint32_t done = out - 1;
+		sharing.ends[done] = out;
+		sharing.hashes[done] = hash;
+
+		// the finished subtree is a child of the root on the top, subtrees of the statements are
+		// not shared, their children are
+		while (!sp::is_empty(frames)){
+			SharingFrame &top = sp::back(frames);
+			top.hash = mix_subtree_hash(top.hash, sharing.hashes[done]);
+			if (--top.remaining) break;
+			SharingFrame frame = sp::pop_val(frames);
+			done = frame.out;
+			sharing.ends[done] = out;
+			sharing.hashes[done] = frame.hash;
+
+			const Node &root = ptr[done];
+			size_t root_arity = expression_arity(root);
+			if (root_arity != statement_arity(root)) continue;
+			uint32_t first_copy = find_first_copy(sharing, done, root_arity);
+			if (first_copy == done) continue;
+
+			Node reference{NodeType::SharedSubtree, root.pos};
+			reference.u16 = 0;
+			reference.data.index = first_copy;
+			ptr[done] = reference;
+			out = done + 1;
+			sharing.ends[done] = out;
+			sharing.hashes[done] = frame.hash;
+		}
+	}
+	for (; label!=labels_end; ++label) label->index = out;
+
+	sp::deinit(frames);
+	sp::deinit(sharing.table);
+	sp::deinit(hashes);
+	sp::deinit(ends);
+	sp::resize(nodes, out);
+	return size - out;
+}
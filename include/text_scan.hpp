@@ -0,0 +1,457 @@
+#pragma once
+
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+	#include <immintrin.h>
+	#define TEXT_SCAN_X86
+#endif
+
+#include "SPL/Utils.hpp"
+
+// Vectorized searches over the '\0' terminated source text.
+// Loads are aligned to the vector width, so they never cross a page boundary and can safely
+// read past the sentinel. Every search stops at '\0' so it cannot run off the end of the text.
+
+// CHARACTER CLASSES
+enum CharClass : uint8_t{
+	CharBlank     = 1 << 0, // ' ', '\t', '\n'
+	CharNameFirst = 1 << 1, // letters and '_'
+	CharName      = 1 << 2, // letters, digits and '_'
+	CharDigit     = 1 << 3, // '0' ... '9'
+};
+
+struct CharClassTableType{
+	SP_CI uint8_t operator [](char c) const noexcept{ return data[(uint8_t)c]; }
+
+	uint8_t data[256];
+};
+
+SP_CSI CharClassTableType make_char_class_table() noexcept{
+	CharClassTableType table{};
+	table.data[(uint8_t)' '] = CharBlank;
+	table.data[(uint8_t)'\t'] = CharBlank;
+	table.data[(uint8_t)'\n'] = CharBlank;
+	for (uint32_t c='a'; c<='z'; ++c) table.data[c] = CharNameFirst | CharName;
+	for (uint32_t c='A'; c<='Z'; ++c) table.data[c] = CharNameFirst | CharName;
+	for (uint32_t c='0'; c<='9'; ++c) table.data[c] = CharName | CharDigit;
+	table.data[(uint8_t)'_'] = CharNameFirst | CharName;
+	return table;
+}
+
+constexpr CharClassTableType CharClassTable = make_char_class_table();
+
+
+
+enum class ScanKind{
+	Blank,       // first byte that is not ' ', '\t' or '\n'
+	LineEnd,     // first '\n' or '\0'
+	CommentChar, // first '*', '/' or '\0'
+	NameEnd,     // first byte that cannot be a part of a name
+	RowEnd,      // first '\n', '\v' or '\0'
+	StringChar,  // first '"', '\'', '\\', '\n' or '\0', bytes that a string literal cannot copy
+	Quote,       // first '"' or '\0'
+};
+
+template<ScanKind K>
+SP_CSI bool scan_stops_at(char c) noexcept{
+	if constexpr (K == ScanKind::Blank) return !(CharClassTable[c] & CharBlank);
+	if constexpr (K == ScanKind::LineEnd) return c=='\n' || c=='\0';
+	if constexpr (K == ScanKind::CommentChar) return c=='*' || c=='/' || c=='\0';
+	if constexpr (K == ScanKind::NameEnd) return !(CharClassTable[c] & CharName);
+	if constexpr (K == ScanKind::RowEnd) return c=='\n' || c=='\v' || c=='\0';
+	if constexpr (K == ScanKind::StringChar)
+		return c=='"' || c=='\'' || c=='\\' || c=='\n' || c=='\0';
+	if constexpr (K == ScanKind::Quote) return c=='"' || c=='\0';
+}
+
+template<ScanKind K>
+const char *scan_scalar(const char *input) noexcept{
+	while (!scan_stops_at<K>(*input)) ++input;
+	return input;
+}
+
+
+#ifdef TEXT_SCAN_X86
+
+// bytes from the range [first, first+count) are selected with a single signed comparison,
+// the bias moves the range to the bottom of the signed byte
+__attribute__((target("sse2"))) inline __m128i in_range_sse2(__m128i v, char first, char count) noexcept{
+	return _mm_cmplt_epi8(
+		_mm_add_epi8(v, _mm_set1_epi8((char)(0x80 - first))), _mm_set1_epi8((char)(0x80 + count))
+	);
+}
+
+__attribute__((target("avx2"))) inline __m256i in_range_avx2(__m256i v, char first, char count) noexcept{
+	return _mm256_cmpgt_epi8(
+		_mm256_set1_epi8((char)(0x80 + count)), _mm256_add_epi8(v, _mm256_set1_epi8((char)(0x80 - first)))
+	);
+}
+
+template<ScanKind K>
+__attribute__((target("sse2"))) inline uint32_t scan_mask_sse2(__m128i v) noexcept{
+	if constexpr (K == ScanKind::Blank){
+		__m128i blank = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))
+		);
+		return ~(uint32_t)_mm_movemask_epi8(blank) & 0xffff;
+	}
+	if constexpr (K == ScanKind::LineEnd){
+		return _mm_movemask_epi8(_mm_or_si128(
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_setzero_si128())
+		));
+	}
+	if constexpr (K == ScanKind::CommentChar){
+		return _mm_movemask_epi8(_mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('*')), _mm_cmpeq_epi8(v, _mm_set1_epi8('/'))),
+			_mm_cmpeq_epi8(v, _mm_setzero_si128())
+		));
+	}
+	if constexpr (K == ScanKind::NameEnd){
+		__m128i name = _mm_or_si128(
+			_mm_or_si128(
+				in_range_sse2(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 26), in_range_sse2(v, '0', 10)
+			),
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('_'))
+		);
+		return ~(uint32_t)_mm_movemask_epi8(name) & 0xffff;
+	}
+	if constexpr (K == ScanKind::RowEnd){
+		return _mm_movemask_epi8(_mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\v'))),
+			_mm_cmpeq_epi8(v, _mm_setzero_si128())
+		));
+	}
+	if constexpr (K == ScanKind::StringChar){
+		return _mm_movemask_epi8(_mm_or_si128(
+			_mm_or_si128(
+				_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\''))),
+				_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\\')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')))
+			),
+			_mm_cmpeq_epi8(v, _mm_setzero_si128())
+		));
+	}
+	if constexpr (K == ScanKind::Quote){
+		return _mm_movemask_epi8(_mm_or_si128(
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('"')), _mm_cmpeq_epi8(v, _mm_setzero_si128())
+		));
+	}
+}
+
+template<ScanKind K>
+__attribute__((target("avx2"))) inline uint32_t scan_mask_avx2(__m256i v) noexcept{
+	if constexpr (K == ScanKind::Blank){
+		__m256i blank = _mm256_or_si256(
+			_mm256_or_si256(
+				_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))
+			),
+			_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))
+		);
+		return ~(uint32_t)_mm256_movemask_epi8(blank);
+	}
+	if constexpr (K == ScanKind::LineEnd){
+		return _mm256_movemask_epi8(_mm256_or_si256(
+			_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(v, _mm256_setzero_si256())
+		));
+	}
+	if constexpr (K == ScanKind::CommentChar){
+		return _mm256_movemask_epi8(_mm256_or_si256(
+			_mm256_or_si256(
+				_mm256_cmpeq_epi8(v, _mm256_set1_epi8('*')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('/'))
+			),
+			_mm256_cmpeq_epi8(v, _mm256_setzero_si256())
+		));
+	}
+	if constexpr (K == ScanKind::NameEnd){
+		__m256i name = _mm256_or_si256(
+			_mm256_or_si256(
+				in_range_avx2(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 26), in_range_avx2(v, '0', 10)
+			),
+			_mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'))
+		);
+		return ~(uint32_t)_mm256_movemask_epi8(name);
+	}
+	if constexpr (K == ScanKind::RowEnd){
+		return _mm256_movemask_epi8(_mm256_or_si256(
+			_mm256_or_si256(
+				_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\v'))
+			),
+			_mm256_cmpeq_epi8(v, _mm256_setzero_si256())
+		));
+	}
+	if constexpr (K == ScanKind::StringChar){
+		return _mm256_movemask_epi8(_mm256_or_si256(
+			_mm256_or_si256(
+				_mm256_or_si256(
+					_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\''))
+				),
+				_mm256_or_si256(
+					_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))
+				)
+			),
+			_mm256_cmpeq_epi8(v, _mm256_setzero_si256())
+		));
+	}
+	if constexpr (K == ScanKind::Quote){
+		return _mm256_movemask_epi8(_mm256_or_si256(
+			_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')), _mm256_cmpeq_epi8(v, _mm256_setzero_si256())
+		));
+	}
+}
+
+template<ScanKind K>
+__attribute__((target("sse2"))) const char *scan_sse2(const char *input) noexcept{
+	const char *block = (const char *)((uintptr_t)input & ~(uintptr_t)15);
+	uint32_t bits = scan_mask_sse2<K>(_mm_load_si128((const __m128i *)block));
+	bits &= 0xffffu << (input - block);
+	while (!bits){
+		block += 16;
+		bits = scan_mask_sse2<K>(_mm_load_si128((const __m128i *)block));
+	}
+	return block + __builtin_ctz(bits);
+}
+
+template<ScanKind K>
+__attribute__((target("avx2"))) const char *scan_avx2(const char *input) noexcept{
+	const char *block = (const char *)((uintptr_t)input & ~(uintptr_t)31);
+	uint32_t bits = scan_mask_avx2<K>(_mm256_load_si256((const __m256i *)block));
+	bits &= 0xffffffffu << (input - block);
+	while (!bits){
+		block += 32;
+		bits = scan_mask_avx2<K>(_mm256_load_si256((const __m256i *)block));
+	}
+	return block + __builtin_ctz(bits);
+}
+
+inline bool cpu_has_avx2() noexcept{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+
+#endif
+
+
+// picks the widest implementation supported by the processor on the first call
+template<ScanKind K>
+const char *scan_text(const char *input) noexcept{
+#ifdef TEXT_SCAN_X86
+	static const auto proc = cpu_has_avx2() ? scan_avx2<K> : scan_sse2<K>;
+	return proc(input);
+#else
+	return scan_scalar<K>(input);
+#endif
+}
+
+inline const char *skip_blanks(const char *input) noexcept{
+	return scan_text<ScanKind::Blank>(input);
+}
+
+inline const char *find_line_end(const char *input) noexcept{
+	return scan_text<ScanKind::LineEnd>(input);
+}
+
+inline const char *find_comment_char(const char *input) noexcept{
+	return scan_text<ScanKind::CommentChar>(input);
+}
+
+inline const char *find_name_end(const char *input) noexcept{
+	return scan_text<ScanKind::NameEnd>(input);
+}
+
+inline const char *find_row_end(const char *input) noexcept{
+	return scan_text<ScanKind::RowEnd>(input);
+}
+
+inline const char *find_string_char(const char *input) noexcept{
+	return scan_text<ScanKind::StringChar>(input);
+}
+
+inline const char *find_quote(const char *input) noexcept{
+	return scan_text<ScanKind::Quote>(input);
+}
+
+
+
+// UTF-8 VALIDATION
+// Runs of text are validated at once. Blocks of ASCII bytes are skipped with a single test,
+// the AVX2 version checks the other blocks with the lookup tables from "Validating UTF-8 In Less
+// Than One Instruction Per Byte" by Keiser and Lemire. Only when an error was found, the scalar
+// version looks for the first invalid sequence.
+
+// length of the valid UTF-8 sequence at the start of the text or 0, it never reaches past the end
+SP_CSI size_t utf8_sequence_length(const char *text, const char *end) noexcept{
+	uint8_t c = text[0];
+	if (c < 0x80) return 1;
+
+	size_t len;
+	uint8_t min = 0x80, max = 0xbf; // range of the second byte
+	if (c < 0xc2){
+		return 0; // continuation byte or overlong sequence
+	} else if (c < 0xe0){
+		len = 2;
+	} else if (c < 0xf0){
+		len = 3;
+		if (c == 0xe0) min = 0xa0;      // overlong
+		else if (c == 0xed) max = 0x9f; // surrogates
+	} else if (c < 0xf5){
+		len = 4;
+		if (c == 0xf0) min = 0x90;      // overlong
+		else if (c == 0xf4) max = 0x8f; // above U+10FFFF
+	} else{
+		return 0;
+	}
+	if ((size_t)(end-text) < len) return 0;
+	if ((uint8_t)text[1]<min || (uint8_t)text[1]>max) return 0;
+	for (size_t i=2; i!=len; ++i)
+		if (((uint8_t)text[i] & 0xc0) != 0x80) return 0;
+	return len;
+}
+
+// returns first byte of the first invalid sequence inside [begin, end) or end
+inline const char *find_invalid_utf8_scalar(const char *begin, const char *end) noexcept{
+	while (begin != end){
+		size_t len = utf8_sequence_length(begin, end);
+		if (!len) return begin;
+		begin += len;
+	}
+	return end;
+}
+
+
+#ifdef TEXT_SCAN_X86
+
+__attribute__((target("sse2"))) const char *find_invalid_utf8_sse2(const char *begin, const char *end) noexcept{
+	while (end-begin >= 16){
+		uint32_t bits = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)begin));
+		if (!bits){
+			begin += 16;
+			continue;
+		}
+		const char *block_end = begin + 16;
+		begin += __builtin_ctz(bits);
+		while (begin < block_end){
+			size_t len = utf8_sequence_length(begin, end);
+			if (!len) return begin;
+			begin += len;
+		}
+	}
+	return find_invalid_utf8_scalar(begin, end);
+}
+
+__attribute__((target("avx2"))) inline __m256i utf8_table_avx2(
+	uint8_t c0, uint8_t c1, uint8_t c2, uint8_t c3, uint8_t c4, uint8_t c5, uint8_t c6, uint8_t c7,
+	uint8_t c8, uint8_t c9, uint8_t c10, uint8_t c11, uint8_t c12, uint8_t c13, uint8_t c14, uint8_t c15
+) noexcept{
+	return _mm256_setr_epi8(
+		c0, c1, c2, c3, c4, c5, c6, c7, c8, c9, c10, c11, c12, c13, c14, c15,
+		c0, c1, c2, c3, c4, c5, c6, c7, c8, c9, c10, c11, c12, c13, c14, c15
+	);
+}
+
+// bytes of the block shifted by N, the last N bytes of the previous block are shifted in
+template<int N>
+__attribute__((target("avx2"))) inline __m256i utf8_prev_avx2(__m256i input, __m256i prev_input) noexcept{
+	return _mm256_alignr_epi8(input, _mm256_permute2x128_si256(prev_input, input, 0x21), 16 - N);
+}
+
+__attribute__((target("avx2"))) inline __m256i utf8_high_nibbles_avx2(__m256i v) noexcept{
+	return _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0f));
+}
+
+// every bit set in the result is an error, errors are classified by the first two bytes of every pair
+__attribute__((target("avx2"))) inline __m256i utf8_errors_avx2(__m256i input, __m256i prev_input) noexcept{
+	constexpr uint8_t TooShort   = 1 << 0; // lead byte not followed by a continuation
+	constexpr uint8_t TooLong    = 1 << 1; // ASCII followed by a continuation
+	constexpr uint8_t Overlong3  = 1 << 2;
+	constexpr uint8_t TooLarge   = 1 << 3; // above U+10FFFF
+	constexpr uint8_t Surrogate  = 1 << 4;
+	constexpr uint8_t Overlong2  = 1 << 5;
+	constexpr uint8_t TooLarge1000 = 1 << 6;
+	constexpr uint8_t Overlong4  = 1 << 6;
+	constexpr uint8_t TwoConts   = 1 << 7; // continuation that has to be the third or fourth byte
+	constexpr uint8_t Carry = TooShort | TooLong | TwoConts;
+
+	__m256i prev1 = utf8_prev_avx2<1>(input, prev_input);
+	__m256i byte_1_high = _mm256_shuffle_epi8(utf8_table_avx2(
+		TooLong, TooLong, TooLong, TooLong, TooLong, TooLong, TooLong, TooLong,
+		TwoConts, TwoConts, TwoConts, TwoConts,
+		TooShort | Overlong2,
+		TooShort,
+		TooShort | Overlong3 | Surrogate,
+		TooShort | TooLarge | TooLarge1000 | Overlong4
+	), utf8_high_nibbles_avx2(prev1));
+	__m256i byte_1_low = _mm256_shuffle_epi8(utf8_table_avx2(
+		Carry | Overlong3 | Overlong2 | Overlong4,
+		Carry | Overlong2,
+		Carry, Carry,
+		Carry | TooLarge,
+		Carry | TooLarge | TooLarge1000, Carry | TooLarge | TooLarge1000, Carry | TooLarge | TooLarge1000,
+		Carry | TooLarge | TooLarge1000, Carry | TooLarge | TooLarge1000, Carry | TooLarge | TooLarge1000,
+		Carry | TooLarge | TooLarge1000, Carry | TooLarge | TooLarge1000,
+		Carry | TooLarge | TooLarge1000 | Surrogate,
+		Carry | TooLarge | TooLarge1000, Carry | TooLarge | TooLarge1000
+	), _mm256_and_si256(prev1, _mm256_set1_epi8(0x0f)));
+	__m256i byte_2_high = _mm256_shuffle_epi8(utf8_table_avx2(
+		TooShort, TooShort, TooShort, TooShort, TooShort, TooShort, TooShort, TooShort,
+		TooLong | Overlong2 | TwoConts | Overlong3 | TooLarge1000 | Overlong4,
+		TooLong | Overlong2 | TwoConts | Overlong3 | TooLarge,
+		TooLong | Overlong2 | TwoConts | Surrogate | TooLarge,
+		TooLong | Overlong2 | TwoConts | Surrogate | TooLarge,
+		TooShort, TooShort, TooShort, TooShort
+	), utf8_high_nibbles_avx2(input));
+	__m256i special = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+	// two continuations in a row are valid only after a lead byte of three or four bytes
+	__m256i third = _mm256_subs_epu8(utf8_prev_avx2<2>(input, prev_input), _mm256_set1_epi8(0xe0-0x80));
+	__m256i fourth = _mm256_subs_epu8(utf8_prev_avx2<3>(input, prev_input), _mm256_set1_epi8(0xf0-0x80));
+	__m256i must_continue = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8(0x80));
+	return _mm256_xor_si256(must_continue, special);
+}
+
+__attribute__((target("avx2"))) const char *find_invalid_utf8_avx2(const char *begin, const char *end) noexcept{
+	// bytes that start a sequence which does not fit into the rest of the block
+	const __m256i max_value = _mm256_setr_epi8(
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0xf0-1, 0xe0-1, 0xc0-1
+	);
+	__m256i prev = _mm256_setzero_si256();
+	__m256i error = _mm256_setzero_si256();
+	__m256i incomplete = _mm256_setzero_si256();
+	const char *it = begin;
+	for (; end-it >= 32; it+=32){
+		__m256i input = _mm256_loadu_si256((const __m256i *)it);
+		if (!_mm256_movemask_epi8(input)){
+			error = _mm256_or_si256(error, incomplete);
+		} else{
+			error = _mm256_or_si256(error, utf8_errors_avx2(input, prev));
+			incomplete = _mm256_subs_epu8(input, max_value);
+		}
+		prev = input;
+	}
+
+	// the rest is padded with zeros, so a sequence that is not finished at the end is an error too
+	alignas(32) char tail[32] = {};
+	__builtin_memcpy(tail, it, end-it);
+	__m256i input = _mm256_load_si256((const __m256i *)tail);
+	if (!_mm256_movemask_epi8(input))
+		error = _mm256_or_si256(error, incomplete);
+	else
+		error = _mm256_or_si256(error, utf8_errors_avx2(input, prev));
+
+	if (_mm256_testz_si256(error, error)) return end;
+	return find_invalid_utf8_scalar(begin, end);
+}
+
+#endif
+
+
+// returns first byte of the first invalid sequence inside [begin, end) or end
+inline const char *find_invalid_utf8(const char *begin, const char *end) noexcept{
+#ifdef TEXT_SCAN_X86
+	static const auto proc = cpu_has_avx2() ? find_invalid_utf8_avx2 : find_invalid_utf8_sse2;
+	return proc(begin, end);
+#else
+	return find_invalid_utf8_scalar(begin, end);
+#endif
+}
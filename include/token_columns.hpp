@@ -0,0 +1,115 @@
+#pragma once
+
+#include "tokenizer.hpp"
+
+// Tokens stored as separate columns, a type takes one byte and a position four. Only literals
+// and names have the u16 and data fields, they are kept in a side table in the order of tokens,
+// so every token takes 5 bytes and a token with a value 15 bytes, instead of 16 for a Node.
+// ColumnCursor keeps the index into the side table while it moves, so the parsers can use it
+// in place of a pointer into the token array.
+
+static_assert((size_t)NodeType::SharedSubtree < 256, "token types have to fit into a byte");
+
+struct TokenColumns{
+	sp::DynamicArray<uint8_t, sp::MallocAllocator<>> types;
+	sp::DynamicArray<uint32_t, sp::MallocAllocator<>> positions;
+
+	// SIDE TABLE
+	sp::DynamicArray<uint16_t, sp::MallocAllocator<>> u16s;
+	sp::DynamicArray<Node::Data, sp::MallocAllocator<>> datas;
+};
+
+SP_CSI bool has_token_value(NodeType type) noexcept{
+	return (NodeType::Integer<=type && type<=NodeType::String) || type==NodeType::Name;
+}
+
+// tokens have to be final, it means that the lexer will not change them anymore
+void append_tokens(TokenColumns &columns, const Node *tokens, size_t count) noexcept{
+	size_t first = sp::len(columns.types);
+	sp::resize(columns.types, first+count);
+	sp::resize(columns.positions, first+count);
+	uint8_t *types = sp::beg(columns.types) + first;
+	uint32_t *positions = sp::beg(columns.positions) + first;
+	for (size_t i=0; i!=count; ++i){
+		types[i] = (uint8_t)tokens[i].type;
+		positions[i] = tokens[i].pos;
+		if (has_token_value(tokens[i].type)){
+			sp::push_value(columns.u16s, tokens[i].u16);
+			sp::push_value(columns.datas, tokens[i].data);
+		}
+	}
+}
+
+constexpr size_t TokenColumnsStep = (size_t)64 << 10; // bytes of text lexed before tokens are moved
+
+// tokens are moved to the columns while the text is lexed, so they are never all stored as nodes
+TokenColumns make_token_columns(const char *input) noexcept{
+	TokenColumns columns;
+	TokenizerState lexer;
+	while (!lexer.finished){
+		input = lex_tokens<true>(lexer, input, input+TokenColumnsStep);
+		size_t count = final_token_count(lexer);
+		append_tokens(columns, sp::beg(lexer.tokens), count);
+		drop_tokens(lexer, count);
+	}
+	sp::deinit(lexer.tokens);
+	sp::deinit(lexer.outer_closes);
+	return columns;
+}
+
+void deinit(TokenColumns &columns) noexcept{
+	sp::deinit(columns.types);
+	sp::deinit(columns.positions);
+	sp::deinit(columns.u16s);
+	sp::deinit(columns.datas);
+}
+
+
+// node returned by the arrow operator of the cursor
+struct NodeProxy{
+	inline const Node *operator ->() const noexcept{ return &node; }
+
+	Node node;
+};
+
+struct ColumnCursor{
+	// u16 and data of tokens without a value are zero
+	inline Node operator *() const noexcept{
+		Node node{(NodeType)columns->types[index], columns->positions[index]};
+		node.u16 = 0;
+		node.data.u64 = 0;
+		if (has_token_value(node.type)){
+			node.u16 = columns->u16s[value_index];
+			node.data = columns->datas[value_index];
+		}
+		return node;
+	}
+	inline NodeProxy operator ->() const noexcept{ return NodeProxy{**this}; }
+
+	SP_CI ColumnCursor &operator ++() noexcept{
+		value_index += has_token_value((NodeType)columns->types[index]);
+		++index;
+		return *this;
+	}
+	SP_CI ColumnCursor &operator --() noexcept{
+		--index;
+		value_index -= has_token_value((NodeType)columns->types[index]);
+		return *this;
+	}
+	SP_CI ColumnCursor &operator +=(size_t offset) noexcept{
+		for (; offset; --offset) ++*this;
+		return *this;
+	}
+	SP_CI ColumnCursor operator +(size_t offset) const noexcept{ ColumnCursor it = *this; return it += offset; }
+	SP_CI ColumnCursor operator -(size_t offset) const noexcept{
+		ColumnCursor it = *this;
+		for (; offset; --offset) --it;
+		return it;
+	}
+
+	const TokenColumns *columns;
+	size_t index;
+	size_t value_index;
+};
+
+SP_CSI ColumnCursor beg(const TokenColumns &columns) noexcept{ return ColumnCursor{&columns, 0, 0}; }
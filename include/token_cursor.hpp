@@ -0,0 +1,71 @@
+#pragma once
+
+#include "tokenizer.hpp"
+
+// Tokens that are lexed from the '\0' terminated text only when the parser reaches them.
+// Only tokens that can still change and a few already read ones are kept in memory.
+// TokenCursor behaves like a pointer into the token array, so the parsers work with both.
+
+constexpr size_t LazyTokensStep = 512;   // bytes of text lexed at once
+constexpr size_t LazyTokensHistory = 16; // already read tokens that stay accessible
+
+struct LazyTokens{
+	TokenizerState lexer;
+	const char *input;
+	size_t base = 0;  // index of the first token kept inside lexer.tokens
+	size_t ready = 0; // number of tokens inside lexer.tokens that will not change anymore
+};
+
+LazyTokens make_lazy_tokens(const char *input) noexcept{
+	LazyTokens src;
+	src.input = input;
+	return src;
+}
+
+
+namespace priv__{
+
+// returns offset of the token inside lexer.tokens
+size_t lex_lazy_tokens(LazyTokens &src, size_t index) noexcept{
+	size_t offset = index - src.base;
+	if (offset > 2*LazyTokensHistory){
+		size_t count = offset - LazyTokensHistory;
+		drop_tokens(src.lexer, count);
+		src.base += count;
+		src.ready -= count;
+		offset -= count;
+	}
+
+	while (offset >= src.ready){
+		[[unlikely]] if (src.lexer.finished) return sp::len(src.lexer.tokens) - 1; // stays at the Null
+		src.input = lex_tokens<true>(src.lexer, src.input, src.input+LazyTokensStep);
+		src.ready = final_token_count(src.lexer);
+	}
+	return offset;
+}
+
+} // END OF NAMESPACE priv__
+
+SP_CSI const Node &lazy_token(LazyTokens &src, size_t index) noexcept{
+	size_t offset = index - src.base;
+	[[unlikely]] if (offset >= src.ready) offset = priv__::lex_lazy_tokens(src, index);
+	return src.lexer.tokens[offset];
+}
+
+
+// references returned by the cursor are valid until the next token is lexed
+struct TokenCursor{
+	SP_CI const Node &operator *() const noexcept{ return lazy_token(*source, index); }
+	SP_CI const Node *operator ->() const noexcept{ return &lazy_token(*source, index); }
+
+	SP_CI TokenCursor &operator ++() noexcept{ ++index; return *this; }
+	SP_CI TokenCursor &operator --() noexcept{ --index; return *this; }
+	SP_CI TokenCursor &operator +=(size_t offset) noexcept{ index += offset; return *this; }
+	SP_CI TokenCursor operator +(size_t offset) const noexcept{ return TokenCursor{source, index+offset}; }
+	SP_CI TokenCursor operator -(size_t offset) const noexcept{ return TokenCursor{source, index-offset}; }
+
+	LazyTokens *source;
+	size_t index;
+};
+
+SP_CSI TokenCursor beg(LazyTokens &src) noexcept{ return TokenCursor{&src, src.base}; }
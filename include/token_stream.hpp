@@ -0,0 +1,224 @@
+#pragma once
+
+#include "tokenizer.hpp"
+
+// Tokenizer that is fed with the source text in chunks of any size.
+// Text is lexed only up to the last position where the lexer is surely between two tokens,
+// which is right after a blank character or after a token that nothing continues (; , ) and })
+// outside of comments, strings and character literals.
+// The rest of the chunk waits for the next one, so memory is bounded by the chunk size, the longest
+// token and tokens that are held back by open braces, which are not yet known to be scopes.
+// Positions inside tokens are offsets from the start of the whole stream.
+
+constexpr size_t TokenStreamChunkSize = (size_t)64 << 10;
+constexpr size_t TokenStreamContext = 2; // lexed bytes kept before the text, '=' looks two bytes back
+constexpr TokenizerOptions TokenStreamOptions{.source_strings = false}; // the text is not kept
+
+struct TokenStream{
+	enum class Mode : uint8_t{ Code, LineComment, BlockComment, String, RawString };
+
+	TokenizerState lexer;
+	sp::DynamicArray<char, sp::MallocAllocator<>> window; // context followed by the text that waits for lexing
+	size_t scan_pos = TokenStreamContext; // offset inside window where the prescan stopped
+	size_t cut_pos = TokenStreamContext;  // offset inside window up to which text can be lexed
+	uint32_t comment_depth = 0;
+	uint32_t raw_hashes = 0; // number of '#' that close the raw string literal
+	Mode mode = Mode::Code;
+};
+
+
+namespace priv__{
+
+// ' between two digits of a number literal is a separator, not a character literal
+inline bool is_digit_separator(const char *first, const char *input) noexcept{
+	const char *start = input;
+	while (start != first && is_valid_name_char(start[-1])) --start;
+	if (start == input || !is_number(*start)) return false;
+
+	uint32_t base = 10;
+	if (start[0] == '0' && input-start > 2){
+		if (start[1] == 'x') base = 16;
+		if (start[1] == 'o') base = 8;
+		if (start[1] == 'b') base = 2;
+	}
+	return DigitValue[input[1]] < base;
+}
+
+// the token before it cannot grow and the lexer does not change it, '=' and ']' merge with the token
+// before them, the next byte is not known at the end of the window
+inline bool is_closed_token(const char *it, const char *last_char) noexcept{
+	char c = it[-1];
+	return (c==';' || c==',' || c==')' || c=='}') && it!=last_char && *it!='=' && *it!=']';
+}
+
+// follows comments, strings and character literals the same way the lexer does,
+// stops before constructs that could continue past the end of the window
+inline void prescan_window(TokenStream &stream) noexcept{
+	const char *text = sp::beg(stream.window);
+	const char *input = text + stream.scan_pos;
+	const char *last_char = text + sp::len(stream.window) - 1; // window ends with '\0'
+	const char *cut = nullptr;
+
+	while (input < last_char){
+		switch (stream.mode){
+		case TokenStream::Mode::Code:{
+			const char *special = input;
+			while (
+				special!=last_char && *special!='/' && *special!='\"' && *special!='\'' && *special!='#'
+			) ++special;
+			// the start is checked too, the byte after the end of the last scan was not known then
+			for (const char *it=special; it+1!=input; --it)
+				if (is_blank(it[-1]) || is_closed_token(it, last_char)){
+					cut = it;
+					break;
+				}
+			input = special;
+			if (input == last_char) break;
+
+			if (*input == '/'){
+				if (input+1 == last_char) goto Stop;
+				if (input[1] == '/'){
+					stream.mode = TokenStream::Mode::LineComment;
+					input += 2;
+				} else if (input[1] == '*'){
+					stream.mode = TokenStream::Mode::BlockComment;
+					stream.comment_depth = 1;
+					input += 2;
+				} else{
+					++input;
+				}
+			} else if (*input == '\"'){
+				stream.mode = TokenStream::Mode::String;
+				++input;
+			} else if (*input == '#'){
+				const char *it = input + 1;
+				while (*it == '#') ++it;
+				if (it == last_char) goto Stop;
+				if (*it == '\"'){
+					stream.mode = TokenStream::Mode::RawString;
+					stream.raw_hashes = it - input;
+					++it;
+				}
+				input = it;
+			} else if (priv__::is_digit_separator(text, input)){
+				++input;
+			} else{
+				const char *it = input + 1;
+				get_char_from_iterator(&it);
+				if (it >= last_char) goto Stop;
+				input = *it == '\'' ? it+1 : input+1;
+			}
+			break;
+		}
+		case TokenStream::Mode::LineComment:
+			input = find_line_end(input);
+			if (input == last_char) break;
+			stream.mode = TokenStream::Mode::Code;
+			break;
+
+		case TokenStream::Mode::BlockComment:
+			input = find_comment_char(input);
+			if (input == last_char) break;
+			if (input+1 == last_char) goto Stop;
+			if (input[0]=='*' && input[1]=='/'){
+				input += 2;
+				if (--stream.comment_depth == 0) stream.mode = TokenStream::Mode::Code;
+			} else if (input[0]=='/' && input[1]=='*'){
+				input += 2;
+				++stream.comment_depth;
+			} else{
+				++input;
+			}
+			break;
+
+		case TokenStream::Mode::String:{
+			if (*input == '\"'){
+				stream.mode = TokenStream::Mode::Code;
+				++input;
+				break;
+			}
+			const char *it = input;
+			get_char_from_iterator(&it); // invalid characters are skipped by the lexer, the string goes on
+			if (it >= last_char) goto Stop;
+			input = it;
+			break;
+		}
+		case TokenStream::Mode::RawString:{
+			input = find_quote(input);
+			if (input == last_char) break;
+			size_t count = 0;
+			while (count!=stream.raw_hashes && input[1+count]=='#') ++count;
+			if (count == stream.raw_hashes){
+				input += 1 + count;
+				stream.mode = TokenStream::Mode::Code;
+			} else if (input+1+count == last_char){
+				goto Stop;
+			} else{
+				++input;
+			}
+			break;
+		}
+		}
+	}
+Stop:
+	stream.scan_pos = input - text;
+	if (cut) stream.cut_pos = cut - text;
+}
+
+inline void lex_window(TokenStream &stream, const char *limit) noexcept{
+	char *text = sp::beg(stream.window);
+	const char *stop = lex_tokens<true, TokenStreamOptions>(stream.lexer, text+TokenStreamContext, limit);
+
+	size_t consumed = stop - text - TokenStreamContext;
+	if (consumed == 0) return;
+	size_t size = sp::len(stream.window) - consumed;
+	memmove(text, text+consumed, size);
+	sp::resize(stream.window, size);
+	stream.scan_pos -= consumed;
+	stream.cut_pos = TokenStreamContext; // the lexer always stops at or after the cut
+}
+
+} // END OF NAMESPACE priv__
+
+
+// appends the chunk to the stream and lexes everything that is complete
+void stream_tokens(TokenStream &stream, const char *chunk, size_t size) noexcept{
+	if (stream.lexer.finished) return;
+	if (sp::is_empty(stream.window)){
+		sp::push_range(stream.window, sp::Range<const char>{"  ", TokenStreamContext});
+	} else{
+		sp::pop(stream.window); // sentinel
+	}
+	sp::push_range(stream.window, sp::Range<const char>{chunk, size});
+	sp::push_value(stream.window, '\0');
+
+	priv__::prescan_window(stream);
+	if (stream.cut_pos > TokenStreamContext)
+		priv__::lex_window(stream, sp::beg(stream.window) + stream.cut_pos);
+}
+
+// lexes the rest of the text, after this call all tokens are final and the last one is Null
+void finish_token_stream(TokenStream &stream) noexcept{
+	if (stream.lexer.finished) return;
+	if (sp::is_empty(stream.window)) stream_tokens(stream, "", 0);
+	lex_tokens<false, TokenStreamOptions>(stream.lexer, sp::beg(stream.window)+TokenStreamContext, nullptr);
+	sp::resize(stream.window, TokenStreamContext);
+	sp::push_value(stream.window, '\0');
+}
+
+// moves at most capacity tokens, that will not be changed anymore, to the buffer
+size_t take_tokens(TokenStream &stream, Node *buffer, size_t capacity) noexcept{
+	size_t ready = final_token_count(stream.lexer);
+	size_t count = ready < capacity ? ready : capacity;
+	if (count == 0) return 0;
+
+	memcpy(buffer, sp::beg(stream.lexer.tokens), count*sizeof(Node));
+	drop_tokens(stream.lexer, count);
+	return count;
+}
+
+void deinit(TokenStream &stream) noexcept{
+	sp::deinit(stream.lexer.tokens);
+	sp::deinit(stream.window);
+	stream = TokenStream{};
+}
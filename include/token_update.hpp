@@ -0,0 +1,196 @@
+#pragma once
+
+#include "tokenizer.hpp"
+
+// Tokens of an edited text are updated without tokenizing the whole text again.
+// Lexing starts a few bytes before the edit, at the start of a token, and goes on until two new
+// tokens after the edit are equal to the old ones at the shifted positions. From there the lexer
+// would produce the old tokens again, so they are kept and only their positions are shifted.
+// Comments and string literals that are opened or closed by the edit make the lexer run further,
+// until the old and the new tokens line up again.
+
+// replaced bytes [offset, offset+removed) of the old text by inserted bytes
+struct TextEdit{
+	uint32_t offset;
+	uint32_t removed;
+	uint32_t inserted;
+};
+
+constexpr uint32_t TokenUpdateMargin = 4; // tokens can look up to 3 bytes past their start
+constexpr size_t TokenUpdateContext = 2;  // '=' and ']' can change the two previous tokens
+
+
+namespace priv__{
+
+// first token at or after the position
+inline size_t find_token(const Node *tokens, size_t count, uint64_t pos) noexcept{
+	size_t first = 0;
+	while (count){
+		size_t half = count / 2;
+		if (tokens[first+half].pos < pos){
+			first += half + 1;
+			count -= half + 1;
+		} else{
+			count = half;
+		}
+	}
+	return first;
+}
+
+// open brace is a scope if a semicolon appears directly inside it, as when the lexer resolves it
+inline void resolve_brace(Node *tokens, size_t index) noexcept{
+	size_t depth = 0;
+	NodeType type = NodeType::OpenBrace;
+	for (const Node *it=tokens+index+1; it->type!=NodeType::Null; ++it){
+		if (it->type==NodeType::OpenBrace || it->type==NodeType::OpenScope){
+			++depth;
+		} else if (it->type == NodeType::CloseBrace){
+			if (!depth) break;
+			--depth;
+		} else if (it->type==NodeType::Terminator && !depth){
+			type = NodeType::OpenScope;
+			break;
+		}
+	}
+	tokens[index].type = type;
+}
+
+// at most count braces around the token, starting with the innermost one
+inline void find_outer_braces(
+	const Node *tokens, size_t index, sp::FiniteArray<uint32_t, 32> &braces, size_t count
+) noexcept{
+	size_t depth = 0;
+	while (index-- && sp::len(braces)!=count && !sp::is_full(braces)){
+		NodeType type = tokens[index].type;
+		if (type == NodeType::CloseBrace){
+			++depth;
+		} else if (type==NodeType::OpenBrace || type==NodeType::OpenScope){
+			if (depth) --depth;
+			else sp::push_value(braces, (uint32_t)index);
+		}
+	}
+}
+
+} // END OF NAMESPACE priv__
+
+
+// text is the whole text after the edit, tokens must be the result of tokenizing the text before it
+void update_tokens(
+	sp::DynamicArray<Node, sp::MallocAllocator<>> &tokens, const char *text, TextEdit edit
+) noexcept{
+	int64_t delta = (int64_t)edit.inserted - (int64_t)edit.removed;
+	int64_t new_edit_end = (int64_t)edit.offset + edit.inserted;
+	Node *old_tokens = sp::beg(tokens);
+	size_t old_count = sp::len(tokens);
+
+	// lexing starts at the last token that cannot reach the edit,
+	// if there is none, it starts at the start of the text
+	size_t start = priv__::find_token(old_tokens, old_count, edit.offset);
+	while (start && old_tokens[start-1].pos+TokenUpdateMargin > edit.offset) --start;
+	uint32_t start_pos = 0;
+	if (start){
+		--start;
+		start_pos = old_tokens[start].pos;
+	}
+	size_t context = start < TokenUpdateContext ? start : TokenUpdateContext;
+
+	TokenizerState lexer;
+	sp::push_range(lexer.tokens, sp::Range<const Node>{old_tokens+start-context, context});
+	lexer.curr.pos = start_pos;
+	for (size_t i=start-context; i!=start; ++i)
+		if (old_tokens[i].type == NodeType::OpenBracket)
+			lexer.bracket_expression = !is_whitespace(text[old_tokens[i].pos+1]);
+
+	// new tokens line up with the old ones, when the lexer stops right at the start of an old token
+	// and the last two new tokens after the edit are equal to the old ones before it
+	const char *input = text + start_pos;
+	size_t end = priv__::find_token(old_tokens, old_count, (uint64_t)edit.offset+edit.removed);
+	for (;;){
+		int64_t stop = input - text;
+		while (end!=old_count && old_tokens[end].pos+delta<stop) ++end;
+		if (end == old_count){
+			lex_tokens<false>(lexer, input, nullptr);
+			break;
+		}
+		if (old_tokens[end].pos+delta == stop){
+			const Node *new_last = sp::end(lexer.tokens);
+			if (
+				sp::len(lexer.tokens)>=2 && end>=2 && new_last[-2].pos>=new_edit_end
+				&& new_last[-1].type==old_tokens[end-1].type && new_last[-1].pos==old_tokens[end-1].pos+delta
+				&& new_last[-2].type==old_tokens[end-2].type && new_last[-2].pos==old_tokens[end-2].pos+delta
+			) break;
+			++end;
+			continue;
+		}
+		input = lex_tokens<true>(lexer, input, text + old_tokens[end].pos + delta);
+		[[unlikely]] if (lexer.finished){
+			end = old_count;
+			break;
+		}
+	}
+
+	// braces around the lexed part are checked, if it changed semicolons or braces directly inside them
+	bool old_terminated = false;
+	size_t old_outer_closes = 0;
+	size_t old_open_braces = 0;
+	for (size_t i=start; i!=end; ++i){
+		NodeType type = old_tokens[i].type;
+		if (type==NodeType::OpenBrace || type==NodeType::OpenScope){
+			++old_open_braces;
+		} else if (type == NodeType::CloseBrace){
+			if (old_open_braces) --old_open_braces;
+			else ++old_outer_closes;
+		} else if (type==NodeType::Terminator && !old_open_braces){
+			old_terminated = true;
+		}
+	}
+	size_t new_outer_closes = sp::len(lexer.outer_closes);
+	size_t new_open_braces = sp::len(lexer.scopes);
+
+	// if the lexed part keeps the number of braces it opens and closes, only the braces it closes
+	// and the one it ends in can change, otherwise all braces around it have to be checked
+	sp::FiniteArray<uint32_t, 32> outer_braces;
+	bool same_structure = old_outer_closes==new_outer_closes && old_open_braces==new_open_braces;
+	if (!same_structure)
+		priv__::find_outer_braces(old_tokens, start, outer_braces, SIZE_MAX);
+	else if (new_outer_closes || old_terminated!=lexer.outer_terminated)
+		priv__::find_outer_braces(old_tokens, start, outer_braces, new_outer_closes+1);
+
+	// new tokens replace the old ones from the first context token up to the end
+	// the rest is moved and shifted in one pass
+	size_t first = start - context;
+	size_t new_count = sp::len(lexer.tokens);
+	size_t tail = old_count - end;
+	uint32_t shift = (uint32_t)delta;
+	if (first+new_count > end){
+		sp::resize(tokens, first+new_count+tail);
+		Node *source = sp::beg(tokens) + end;
+		Node *target = sp::beg(tokens) + first + new_count;
+		for (size_t i=tail; i--;){
+			target[i] = source[i];
+			target[i].pos += shift;
+		}
+	} else if (first+new_count < end){
+		Node *source = sp::beg(tokens) + end;
+		Node *target = sp::beg(tokens) + first + new_count;
+		for (size_t i=0; i!=tail; ++i){
+			target[i] = source[i];
+			target[i].pos += shift;
+		}
+		sp::resize(tokens, first+new_count+tail);
+	} else if (shift){
+		for (Node *it=sp::beg(tokens)+end; it!=sp::end(tokens); ++it) it->pos += shift;
+	}
+	memcpy(sp::beg(tokens)+first, sp::beg(lexer.tokens), new_count*sizeof(Node));
+
+	if (same_structure && !new_outer_closes && sp::len(outer_braces) && lexer.outer_terminated){
+		tokens[outer_braces[0]].type = NodeType::OpenScope; // a semicolon was added
+	} else{
+		for (size_t i=0; i!=sp::len(outer_braces); ++i) priv__::resolve_brace(sp::beg(tokens), outer_braces[i]);
+	}
+	for (size_t i=0; i!=sp::len(lexer.scopes); ++i)
+		if (lexer.scopes[i] != ResolvedScope) priv__::resolve_brace(sp::beg(tokens), first+lexer.scopes[i]);
+
+	sp::deinit(lexer.tokens);
+	sp::deinit(lexer.outer_closes);
+}
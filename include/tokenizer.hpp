@@ -2,10 +2,15 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
 
 #include "SPL/Arrays.hpp"
 #include "SPL/Allocators.hpp"
 
+#include "text_scan.hpp"
+#include "number_parser.hpp"
+
 
 constexpr sp::Range<const char> KeywordName[] = {
 // COMPILER DIRECTIVES
@@ -143,12 +148,21 @@ enum class NodeType : uint16_t{
 
 	// TOKEN ONLY
 	Null, Terminator, Colon,
+	Comment, // only produced when the tokenizer keeps comments
+	Error, // returned by the parsers after the error was reported
 
 	// SPECIFICATIONS
 	OutputParameter, DereferenceOutput,
 	AutoParameterPack,
+
+	// PASSES OVER THE OUTPUT
+	SharedSubtree, // data.index is the index of the first copy of an identical subtree
+
+	Count, // not a node type, it stays the last one
 };
 
+constexpr size_t NodeTypeCount = (size_t)NodeType::Count;
+
 
 
 
@@ -194,18 +208,16 @@ template<> struct std::is_trivial<Node>{ constexpr static bool value = true; };
 
 
 
-SP_CSI bool is_valid_name_char(char c){
-	return (c>='a' && c<='z') || (c>='A' && c<='Z') || (c>='0' && c<='9') || c=='_';
-}
+SP_CSI bool is_valid_name_char(char c){ return CharClassTable[c] & CharName; }
 
-SP_CSI bool is_valid_first_name_char(char c){
-	return (c>='a' && c<='z') || (c>='A' && c<='Z') || c=='_';
-}
+SP_CSI bool is_valid_first_name_char(char c){ return CharClassTable[c] & CharNameFirst; }
 
 SP_CSI bool is_number(char c) noexcept{ return (uint8_t)(c-'0') < 10; }
 
 SP_CSI bool is_whitespace(char c) noexcept{ return c==' ' || c=='\n' || c=='\t' || c=='\v'; }
 
+SP_CSI bool is_blank(char c) noexcept{ return CharClassTable[c] & CharBlank; }
+
 SP_CSI bool is_keyword_statement(NodeType type) noexcept{
 	return (
 		(uint32_t)type >= (uint32_t)NodeType::Proc && (uint32_t)type <= (uint32_t)NodeType::Exists
@@ -213,25 +225,357 @@ SP_CSI bool is_keyword_statement(NodeType type) noexcept{
 }
 
 
-// TO DO: add utf-8 support
+
+// PERFECT HASH FOR KEYWORDS AND DIRECTIVES
+// both tables are built at compile time from KeywordName, a name is classified by rejecting it
+// by its length and first character, hashing it and comparing it with the only possible match
+static_assert(sp::len(KeywordName) == (size_t)NodeType::Exists + 1, "KeywordName is out of sync");
+
+struct KeywordHashTable{
+	constexpr static uint32_t SlotBits = 6;
+	constexpr static uint8_t Empty = 0xff;
+
+	uint32_t seed;
+	uint32_t min_len;
+	uint32_t max_len;
+	uint32_t first_chars; // bit (c - 'a') is set for every letter that starts a keyword
+	uint8_t slots[1 << SlotBits];
+};
+
+SP_CSI uint32_t keyword_slot(const char *text, size_t len, uint32_t seed) noexcept{
+	uint32_t key = (
+		(uint32_t)(uint8_t)text[0] | (uint32_t)(uint8_t)text[len-1] << 8
+		| (uint32_t)(uint8_t)text[len>>1] << 16 | (uint32_t)len << 24
+	);
+	return (key * seed) >> (32 - KeywordHashTable::SlotBits);
+}
+
+SP_CSI KeywordHashTable make_keyword_hash_table(uint32_t first, uint32_t last) noexcept{
+	KeywordHashTable table{};
+	table.min_len = UINT32_MAX;
+	for (uint32_t i=first; i!=last; ++i){
+		sp::Range<const char> name = KeywordName[i];
+		if (name.size < table.min_len) table.min_len = name.size;
+		if (name.size > table.max_len) table.max_len = name.size;
+		table.first_chars |= (uint32_t)1 << (name.ptr[0] - 'a');
+	}
+
+	for (uint32_t seed=0x9e3779b1; seed!=0x9e3779b1+2*4096; seed+=2){
+		for (uint8_t &slot : table.slots) slot = KeywordHashTable::Empty;
+		bool collision = false;
+		for (uint32_t i=first; i!=last && !collision; ++i){
+			uint8_t &slot = table.slots[keyword_slot(KeywordName[i].ptr, KeywordName[i].size, seed)];
+			collision = slot != KeywordHashTable::Empty;
+			slot = i;
+		}
+		if (!collision){
+			table.seed = seed;
+			return table;
+		}
+	}
+	table.seed = 0;
+	return table;
+}
+
+constexpr KeywordHashTable DirectiveTable = make_keyword_hash_table(
+	0, (uint32_t)NodeType::Proc
+);
+constexpr KeywordHashTable KeywordTable = make_keyword_hash_table(
+	(uint32_t)NodeType::Proc, (uint32_t)NodeType::Exists + 1
+);
+
+static_assert(DirectiveTable.seed, "no perfect hash was found for the compiler directives");
+static_assert(KeywordTable.seed, "no perfect hash was found for the keywords");
+
+// returns index of the keyword or KeywordHashTable::Empty
+SP_CSI uint32_t find_keyword(const KeywordHashTable &table, sp::Range<const char> text) noexcept{
+	uint32_t first_bit = (uint8_t)text.ptr[0] - (uint32_t)'a';
+	if (text.size < table.min_len || text.size > table.max_len) return KeywordHashTable::Empty;
+	if (first_bit >= 32 || !(table.first_chars >> first_bit & 1)) return KeywordHashTable::Empty;
+
+	uint8_t index = table.slots[keyword_slot(text.ptr, text.size, table.seed)];
+	if (index == KeywordHashTable::Empty) return KeywordHashTable::Empty;
+	sp::Range<const char> keyword = KeywordName[index];
+	if (keyword.size != text.size || __builtin_memcmp(keyword.ptr, text.ptr, text.size))
+		return KeywordHashTable::Empty;
+	return index;
+}
+
+
+
+// OPERATORS
+// every operator is described once in OperatorSpecs, OperatorTable is built from it at compile time
+// with a packed entry for every node type, so the lexer and the parsers get all facts about a token
+// with one lookup, entries of the types that are not operators are empty
+enum OperatorFlag : uint8_t{
+	OperatorRightToLeft = 1 << 0,
+	OperatorSizedArity  = 1 << 1, // data.size is added to the arity
+};
+
+struct OperatorSpec{
+	NodeType type;
+	uint8_t prec;  // binding power after an operand, 0 for the prefix operators
+	uint8_t prefix_prec; // binding power of the operand of a prefix operator
+	uint8_t arity;
+	uint8_t flags;
+	sp::Range<const char> spelling;
+	NodeType assign = NodeType::Null; // followed by '=', Null if there is none
+	NodeType array = NodeType::Null;  // written inside of brackets, Null if there is none
+	NodeType closer = NodeType::Null; // token that closes the bracket opened by the operator
+};
+
+constexpr OperatorSpec OperatorSpecs[] = {
+// PREFIX OPERATORS
+	{NodeType::StaticRun, 0, 0, 1, 0, sp::range("#run")},
+	{NodeType::Inline, 0, 14, 1, 0, sp::range("#inline")},
+	{NodeType::StaticSize, 0, 14, 1, 0, sp::range("#size")},
+	{NodeType::StaticLen, 0, 14, 1, 0, sp::range("#len")},
+	{NodeType::Plus, 0, 14, 1, 0, sp::range("+")},
+	{NodeType::Minus, 0, 14, 1, 0, sp::range("-")},
+	{NodeType::GetAddress, 0, 17, 1, 0, sp::range("*")},
+	{NodeType::Dereference, 0, 14, 1, 0, sp::range("'")},
+	{NodeType::Range, 0, 17, 1, 0, sp::range("[]")},
+	{NodeType::ViewRange, 0, 17, 1, 0, sp::range("[^]")},
+	{NodeType::LogicNot, 0, 14, 1, 0, sp::range("!")},
+	{NodeType::BitNot, 0, 14, 1, 0, sp::range("~")},
+	{NodeType::FixedArray, 0, 18, 2, 0, sp::range("[")},
+	{NodeType::FiniteArray, 0, 18, 2, 0, sp::range("[["), NodeType::Null, NodeType::Null, NodeType::CloseDoubleBracket},
+	{NodeType::ArrayLiteral, 0, 14, 0, OperatorSizedArity, sp::range("{")},
+
+// EXPRESSION OPENING SYMBOLS
+	{NodeType::Comma, 1, 0, 0, 0, sp::range(",")},
+	{NodeType::Slice, 1, 0, 0, 0, sp::range("..")}, // arity depends on the bounds
+	{NodeType::OpenPar, 20, 0, 1, OperatorSizedArity, sp::range("("), NodeType::Null, NodeType::Null, NodeType::ClosePar},
+	{NodeType::OpenBrace, 17, 0, 1, OperatorSizedArity, sp::range("{"), NodeType::Null, NodeType::Null, NodeType::CloseBrace},
+	{NodeType::OpenBracket, 20, 0, 1, OperatorSizedArity, sp::range("["), NodeType::Null, NodeType::Null, NodeType::CloseBracket},
+	{NodeType::GetProcedure, 20, 0, 1, OperatorSizedArity, sp::range(".("), NodeType::Null, NodeType::Null, NodeType::ClosePar},
+	{NodeType::GetSomethingInBraces, 17, 0, 1, OperatorSizedArity, sp::range(".{"), NodeType::Null, NodeType::Null, NodeType::CloseBrace},
+	{NodeType::GetField, 20, 0, 1, OperatorSizedArity, sp::range(".["), NodeType::Null, NodeType::Null, NodeType::CloseBracket},
+
+// LEFT TO RIGHT
+	{NodeType::LogicOr, 3, 0, 2, 0, sp::range("||")},
+	{NodeType::LogicAnd, 4, 0, 2, 0, sp::range("&&")},
+	{NodeType::Equal, 5, 0, 2, 0, sp::range("==")},
+	{NodeType::NotEqual, 5, 0, 2, 0, sp::range("!=")},
+	{NodeType::Lesser, 5, 0, 2, 0, sp::range("<")},
+	{NodeType::Greater, 5, 0, 2, 0, sp::range(">")},
+	{NodeType::LesserEqual, 5, 0, 2, 0, sp::range("<=")},
+	{NodeType::GreaterEqual, 5, 0, 2, 0, sp::range(">=")},
+	{NodeType::Add, 6, 0, 2, 0, sp::range("+"), NodeType::AddAssign, NodeType::ArrayAdd},
+	{NodeType::Subtract, 6, 0, 2, 0, sp::range("-"), NodeType::SubtractAssign, NodeType::ArraySubtract},
+	{NodeType::Multiply, 7, 0, 2, 0, sp::range("*"), NodeType::MultiplyAssign, NodeType::ArrayMultiply},
+	{NodeType::Divide, 7, 0, 2, 0, sp::range("/"), NodeType::DivideAssign, NodeType::ArrayDivide},
+	{NodeType::Modulo, 8, 0, 2, 0, sp::range("%"), NodeType::ModuloAssign, NodeType::ArrayModulo},
+	{NodeType::Concatenate, 9, 0, 2, 0, sp::range("%%"), NodeType::ConcatenateAssign, NodeType::ArrayConcatenate},
+	{NodeType::BitOr, 10, 0, 2, 0, sp::range("|"), NodeType::BitOrAssign, NodeType::ArrayBitOr},
+	{NodeType::BitNor, 10, 0, 2, 0, sp::range("~|"), NodeType::BitNorAssign, NodeType::ArrayBitNor},
+	{NodeType::BitAnd, 11, 0, 2, 0, sp::range("&"), NodeType::BitAndAssign, NodeType::ArrayBitAnd},
+	{NodeType::BitNand, 11, 0, 2, 0, sp::range("~&"), NodeType::BitNandAssign, NodeType::ArrayBitNand},
+	{NodeType::BitXor, 12, 0, 2, 0, sp::range("><"), NodeType::BitXorAssign, NodeType::ArrayBitXor},
+	{NodeType::LeftShift, 13, 0, 2, 0, sp::range("<<"), NodeType::LeftShiftAssign, NodeType::ArrayLeftShift},
+	{NodeType::RightShift, 13, 0, 2, 0, sp::range(">>"), NodeType::RightShiftAssign, NodeType::ArrayRightShift},
+
+	{NodeType::ArrayAdd, 6, 0, 2, 0, sp::range("[+]"), NodeType::ArrayAddAssign},
+	{NodeType::ArraySubtract, 6, 0, 2, 0, sp::range("[-]"), NodeType::ArraySubtractAssign},
+	{NodeType::ArrayMultiply, 7, 0, 2, 0, sp::range("[*]"), NodeType::ArrayMultiplyAssign},
+	{NodeType::ArrayDivide, 7, 0, 2, 0, sp::range("[/]"), NodeType::ArrayDivideAssign},
+	{NodeType::ArrayModulo, 8, 0, 2, 0, sp::range("[%]"), NodeType::ArrayModuloAssign},
+	{NodeType::ArrayConcatenate, 9, 0, 2, 0, sp::range("[%%]"), NodeType::ArrayConcatenateAssign},
+	{NodeType::ArrayBitOr, 10, 0, 2, 0, sp::range("[|]"), NodeType::ArrayBitOrAssign},
+	{NodeType::ArrayBitNor, 10, 0, 2, 0, sp::range("[~|]"), NodeType::ArrayBitNorAssign},
+	{NodeType::ArrayBitAnd, 11, 0, 2, 0, sp::range("[&]"), NodeType::ArrayBitAndAssign},
+	{NodeType::ArrayBitNand, 11, 0, 2, 0, sp::range("[~&]"), NodeType::ArrayBitNandAssign},
+	{NodeType::ArrayBitXor, 12, 0, 2, 0, sp::range("[><]"), NodeType::ArrayBitXorAssign},
+	{NodeType::ArrayLeftShift, 13, 0, 2, 0, sp::range("[<<]"), NodeType::ArrayLeftShiftAssign},
+	{NodeType::ArrayRightShift, 13, 0, 2, 0, sp::range("[>>]"), NodeType::ArrayRightShiftAssign},
+
+	{NodeType::CarryAdd, 6, 0, 2, 0, sp::range("+%")},
+	{NodeType::BorrowSubtract, 6, 0, 2, 0, sp::range("-%")},
+	{NodeType::WideMultiply, 7, 0, 2, 0, sp::range("*%")},
+	{NodeType::ModuloDivide, 7, 0, 2, 0, sp::range("/%")},
+	{NodeType::Access, 18, 0, 2, 0, sp::range(".")},
+
+// RIGHT TO LEFT
+	{NodeType::Assign, 2, 0, 2, OperatorRightToLeft, sp::range("=")},
+	{NodeType::ExpandAssign, 2, 0, 1, OperatorRightToLeft | OperatorSizedArity, sp::range("=")},
+	{NodeType::AddAssign, 2, 0, 2, OperatorRightToLeft, sp::range("+=")},
+	{NodeType::SubtractAssign, 2, 0, 2, OperatorRightToLeft, sp::range("-=")},
+	{NodeType::MultiplyAssign, 2, 0, 2, OperatorRightToLeft, sp::range("*=")},
+	{NodeType::DivideAssign, 2, 0, 2, OperatorRightToLeft, sp::range("/=")},
+	{NodeType::ModuloAssign, 2, 0, 2, OperatorRightToLeft, sp::range("%=")},
+	{NodeType::ConcatenateAssign, 2, 0, 2, OperatorRightToLeft, sp::range("%%=")},
+	{NodeType::BitOrAssign, 2, 0, 2, OperatorRightToLeft, sp::range("|=")},
+	{NodeType::BitNorAssign, 2, 0, 2, OperatorRightToLeft, sp::range("~|=")},
+	{NodeType::BitAndAssign, 2, 0, 2, OperatorRightToLeft, sp::range("&=")},
+	{NodeType::BitNandAssign, 2, 0, 2, OperatorRightToLeft, sp::range("~&=")},
+	{NodeType::BitXorAssign, 2, 0, 2, OperatorRightToLeft, sp::range("><=")},
+	{NodeType::LeftShiftAssign, 2, 0, 2, OperatorRightToLeft, sp::range("<<=")},
+	{NodeType::RightShiftAssign, 2, 0, 2, OperatorRightToLeft, sp::range(">>=")},
+	{NodeType::ArrayAddAssign, 2, 0, 2, OperatorRightToLeft, sp::range("[+]=")},
+	{NodeType::ArraySubtractAssign, 2, 0, 2, OperatorRightToLeft, sp::range("[-]=")},
+	{NodeType::ArrayMultiplyAssign, 2, 0, 2, OperatorRightToLeft, sp::range("[*]=")},
+	{NodeType::ArrayDivideAssign, 2, 0, 2, OperatorRightToLeft, sp::range("[/]=")},
+	{NodeType::ArrayModuloAssign, 2, 0, 2, OperatorRightToLeft, sp::range("[%]=")},
+	{NodeType::ArrayConcatenateAssign, 2, 0, 2, OperatorRightToLeft, sp::range("[%%]=")},
+	{NodeType::ArrayBitOrAssign, 2, 0, 2, OperatorRightToLeft, sp::range("[|]=")},
+	{NodeType::ArrayBitNorAssign, 2, 0, 2, OperatorRightToLeft, sp::range("[~|]=")},
+	{NodeType::ArrayBitAndAssign, 2, 0, 2, OperatorRightToLeft, sp::range("[&]=")},
+	{NodeType::ArrayBitNandAssign, 2, 0, 2, OperatorRightToLeft, sp::range("[~&]=")},
+	{NodeType::ArrayBitXorAssign, 2, 0, 2, OperatorRightToLeft, sp::range("[><]=")},
+	{NodeType::ArrayLeftShiftAssign, 2, 0, 2, OperatorRightToLeft, sp::range("[<<]=")},
+	{NodeType::ArrayRightShiftAssign, 2, 0, 2, OperatorRightToLeft, sp::range("[>>]=")},
+
+	{NodeType::Ternary, 1, 0, 2, OperatorRightToLeft, sp::range("?")},
+	{NodeType::Cast, 16, 0, 2, OperatorRightToLeft, sp::range("->")},
+	{NodeType::Reinterpret, 16, 0, 2, OperatorRightToLeft, sp::range("/>")},
+};
+
+// 32 bytes, so an entry never crosses a cache line
+struct alignas(32) OperatorInfo{
+	uint8_t prec; // 0 means that the token is not an operator after an operand
+	uint8_t prefix_prec;
+	uint8_t arity;
+	uint8_t flags;
+	NodeType assign;
+	NodeType array;
+	NodeType closer;
+	uint8_t spelling_len;
+	char spelling[8];
+};
+
+struct OperatorInfoTable{
+	OperatorInfo infos[NodeTypeCount];
+	bool is_valid;
+};
+
+// the spelling is the other spelling between the prefix and the suffix
+SP_CSI bool is_affixed_spelling(
+	sp::Range<const char> spelling, const char *prefix, sp::Range<const char> other, const char *suffix
+) noexcept{
+	size_t i = 0;
+	for (; *prefix; ++prefix, ++i) if (i==spelling.size || spelling.ptr[i]!=*prefix) return false;
+	for (size_t j=0; j!=other.size; ++j, ++i) if (i==spelling.size || spelling.ptr[i]!=other.ptr[j]) return false;
+	for (; *suffix; ++suffix, ++i) if (i==spelling.size || spelling.ptr[i]!=*suffix) return false;
+	return i == spelling.size;
+}
+
+SP_CSI const OperatorSpec *find_operator_spec(NodeType type) noexcept{
+	for (const OperatorSpec &spec : OperatorSpecs) if (spec.type == type) return &spec;
+	return nullptr;
+}
+
+// a variant is a binary operator with the spelling of the operator inside of the affixes, the assigning
+// variant binds like an assignment and the one for arrays like the operator itself
+SP_CSI bool is_valid_variant(
+	const OperatorSpec &spec, NodeType type, const char *prefix, const char *suffix, bool is_assign
+) noexcept{
+	if (type == NodeType::Null) return true;
+	const OperatorSpec *variant = find_operator_spec(type);
+	const OperatorSpec *assign = find_operator_spec(NodeType::Assign);
+	return (
+		variant && spec.prec && spec.arity==2 && variant->arity==2
+		&& variant->prec == (is_assign ? assign->prec : spec.prec)
+		&& variant->flags == (is_assign ? assign->flags : spec.flags)
+		&& is_affixed_spelling(variant->spelling, prefix, spec.spelling, suffix)
+	);
+}
+
+SP_CSI OperatorInfoTable make_operator_table() noexcept{
+	OperatorInfoTable table{};
+	for (OperatorInfo &info : table.infos){
+		info.assign = NodeType::Null;
+		info.array = NodeType::Null;
+		info.closer = NodeType::Null;
+	}
+	table.is_valid = true;
+	for (const OperatorSpec &spec : OperatorSpecs){
+		OperatorInfo &info = table.infos[(size_t)spec.type];
+		table.is_valid &= (
+			!info.spelling_len && spec.spelling.size && spec.spelling.size<sizeof(info.spelling)
+			&& (spec.prec || !(spec.flags & OperatorRightToLeft))
+			&& (!spec.prec || !spec.prefix_prec)
+			&& is_valid_variant(spec, spec.assign, "", "=", true)
+			&& is_valid_variant(spec, spec.array, "[", "]", false)
+		);
+		info.prec = spec.prec;
+		info.prefix_prec = spec.prefix_prec;
+		info.arity = spec.arity;
+		info.flags = spec.flags;
+		info.spelling_len = spec.spelling.size;
+		info.assign = spec.assign;
+		info.array = spec.array;
+		info.closer = spec.closer;
+		for (size_t i=0; i!=spec.spelling.size && i<sizeof(info.spelling); ++i) info.spelling[i] = spec.spelling.ptr[i];
+	}
+	return table;
+}
+
+constexpr OperatorInfoTable OperatorTable = make_operator_table();
+
+static_assert(sizeof(OperatorInfo) == 32, "entries of the operator table have to stay packed");
+static_assert(
+	OperatorTable.is_valid,
+	"an operator is described twice, its spelling is too long, it binds both after an operand and as a prefix "
+	"or its variant does not match it"
+);
+
+SP_CSI const OperatorInfo &operator_info(NodeType type) noexcept{
+	return OperatorTable.infos[(size_t)type];
+}
+
+SP_CSI size_t right_to_left(NodeType type) noexcept{
+	return operator_info(type).flags & OperatorRightToLeft;
+}
+
+
+// UTF-8
+SP_CSI uint32_t decode_utf8(const char *text, size_t len) noexcept{
+	uint32_t c = (uint8_t)text[0] & (0x7f >> len);
+	for (size_t i=1; i!=len; ++i) c = c<<6 | ((uint8_t)text[i] & 0x3f);
+	return c;
+}
+
+void push_utf8(sp::DynamicArray<char, sp::MallocAllocator<>> &text, uint32_t c) noexcept{
+	if (c < 0x80){
+		sp::push_value(text, (char)c);
+		return;
+	}
+	char bytes[4];
+	size_t len = c<0x800 ? 2 : c<0x10000 ? 3 : 4;
+	bytes[0] = (char)(0xf00 >> len | c >> 6*(len-1));
+	for (size_t i=1; i!=len; ++i) bytes[i] = (char)(0x80 | (c >> 6*(len-1-i) & 0x3f));
+	sp::push_range(text, sp::Range<const char>{bytes, len});
+}
+
+// returns the code point of the character, UTF-8 sequences are decoded and the decimal escapes
+// can be any code point
 uint32_t get_char_from_iterator(const char **inpIter) noexcept{
-	uint32_t c = **inpIter;
+	uint32_t c = (uint8_t)**inpIter;
+	if (c == '\0') return (uint32_t)-1; // the sentinel is never consumed
+	if (c >= 0x80){ // the sequence cannot reach past the sentinel, it is not a continuation byte
+		size_t len = utf8_sequence_length(*inpIter, *inpIter+4);
+		[[unlikely]] if (!len){
+			++*inpIter;
+			return (uint32_t)-1;
+		}
+		c = decode_utf8(*inpIter, len);
+		*inpIter += len;
+		return c;
+	}
 	++*inpIter;
 
-	if (c=='\'' || c== '\"' || c=='\n' || c=='\0') return (uint32_t)-1; // -1 means error
+	if (c=='\'' || c== '\"' || c=='\n') return (uint32_t)-1; // -1 means error
 
 	if (c == '\\')
 		switch (**inpIter){
 		case '\'':
 		case '\"': ++*inpIter;
 			return *(*inpIter-1);
-		case '0' ... '9':
-			c = strtol(*inpIter, (char **)inpIter, 10);
-			if (c > 127){
-				// PLACEHOLDER FOR: translate to utf-8
-				return 0;
-			}
-			return c;
+		case '0' ... '9':{
+			long value = strtol(*inpIter, (char **)inpIter, 10);
+			if (value>0x10ffff || (0xd800<=value && value<0xe000)) return (uint32_t)-1;
+			return value;
+		}
 		case 'n': ++*inpIter;
 			return '\n';
 		case 't': ++*inpIter;
@@ -246,52 +590,113 @@ uint32_t get_char_from_iterator(const char **inpIter) noexcept{
 }
 
 
-// TO DO: save number of the required bits for integer into the u16 field
-// TO DO: add separator syntax from C++
+enum class ErrorId : uint16_t{
+// TOKENIZER
+	IntegerTooBig, NameTooLong,
+	UnfinishedString, InvalidStringCharacter, InvalidUtf8,
+	WrongDirective,
+
+// PARSERS
+	MissingParameterParenthesis, MissingParameterName, ExpectedParameterSpecification,
+	DefaultArguments, MissingClosingParenthesis, MissingFunctionBody,
+	WrongLabelSyntax, MissingConstantName, MissingLabelName,
+	MissingVariableName, ExpectedDeclarationSymbol,
+	MissingSemicolon, InlineAssembly,
+
+	InvalidSlice, CommasInSlice,
+	MissingValue, ExpressionDepth, NotImplemented,
+	TooManyClosingParenthesis, TooManyClosingBraces,
+	TooManyClosingBrackets, TooManyClosingDoubleBrackets,
+	UnmatchedParenthesis, UnmatchedBraces,
+	UnmatchedBrackets, UnmatchedDoubleBrackets,
+};
+
+constexpr const char *ErrorMessage[] = {
+// TOKENIZER
+	"integer literal is too big", "name is too long",
+	"unfinished string literal", "invalid character at string literal", "invalid UTF-8 sequence",
+	"wrong compile time directive",
+
+// PARSERS
+	"missing parenhessis for function's parameters", "missing function's parameter name",
+	"expected parameter specification symbol",
+	"default arguments are not yet supported", "missing closing parenthesis", "missing function's body",
+	"wrong label syntax", "missing name of constant", "missing name of label after goto",
+	"missing variable name", "expected declaration symbol",
+	"missing semicolon", "inline assembly is not yet implemented",
+
+	"invalid usage of the slice operator", "commas inside the slice expression",
+	"missing value", "exceeded expression depth", "not implemented",
+	"too many closing parenthesis", "too many closing braces",
+	"too many closing square brackets", "too many closing double square brackets",
+	"unmatched pair of parenthesis", "unmatched pair of braces",
+	"unmatched pair of square brackets", "unmatched pair of double square brackets",
+};
+
+void raise_error(ErrorId id, uint32_t pos) noexcept;
+
+// u16 field of integer tokens holds the number of bits required to store the value
 Node get_number_token_from_iterator(const char **inpIter, uint32_t pos) noexcept{
 	Node node{NodeType::Integer, pos};
 	node.u16 = 0;
 
 	const char *prevInpIter = *inpIter;
+	DecimalNumber number{0, 0, false};
 
 	char c = **inpIter;
-	if (c == '.') goto ParseFloat;
+	if (c == '.') goto ParseFraction;
 
 	if (c == '0'){
-		++*inpIter;
-		switch (**inpIter){
-		case 'x':
-			node.data.u64 = (uint64_t)strtoul(*inpIter+1, (char **)inpIter, 16);
-			goto ReturnInt;
-		
-		case 'o':
-			node.data.u64 = (uint64_t)strtoul(*inpIter+1, (char **)inpIter, 8);
-			goto ReturnInt;
-
-		case 'b':
-			node.data.u64 = (uint64_t)strtoul(*inpIter+1, (char **)inpIter, 2);
-			goto ReturnInt;
-
+		uint32_t base = 0;
+		switch ((*inpIter)[1]){
+		case 'x': base = 16; break;
+		case 'o': base = 8;  break;
+		case 'b': base = 2;  break;
 		default: break;
 		}
+		if (base){
+			*inpIter += 2;
+			[[unlikely]] if (parse_integer(inpIter, base, &node.data.u64))
+				raise_error(ErrorId::IntegerTooBig, pos);
+			goto ReturnInt;
+		}
 	}
 	{
-		node.data.u64 = (uint64_t)strtoul(*inpIter, (char **)inpIter, 10);
+		bool overflow;
+		overflow = parse_integer(inpIter, 10, &node.data.u64);
 		
 		if (**inpIter == '.' && is_number(*(*inpIter+1))){
-		ParseFloat:
-			node.type = NodeType::Double;
-			node.data.f64 = strtod(prevInpIter, (char**)inpIter);
+			// integer part is reused, unless it is too long to be a mantissa
+			if (overflow || node.data.u64 > MaxDecimalMantissa){
+				*inpIter = prevInpIter;
+				number = parse_decimal(inpIter);
+			} else{
+				number.mantissa = node.data.u64;
+			ParseFraction:
+				parse_decimal_fraction(inpIter, &number);
+			}
+
+			if (**inpIter == 'f'){
+				node.type = NodeType::Float;
+				node.data.f32 = decimal_to_float<float>(number, prevInpIter, *inpIter);
+				++*inpIter;
+			} else{
+				node.type = NodeType::Double;
+				node.data.f64 = decimal_to_float<double>(number, prevInpIter, *inpIter);
+			}
+			return node;
 		}
+		[[unlikely]] if (overflow) raise_error(ErrorId::IntegerTooBig, pos);
 	}
 
 ReturnInt:
+	node.u16 = std::bit_width(node.data.u64);
 	if (**inpIter == 'u'){
 		++*inpIter;
 		node.type = NodeType::Unsigned;
 	} else if (**inpIter == 'f'){
 		++*inpIter;
-		node.data.f32 = node.type==NodeType::Integer ? (float)node.data.u64 : (float)node.data.f64;
+		node.data.f32 = (float)node.data.u64;
 		node.type = NodeType::Float;
 	}
 	return node;
@@ -300,21 +705,64 @@ ReturnInt:
 
 
 
-char *code_text;
+const char *code_text;
 
-void print_codeline(const char *text, size_t position) noexcept{
-	size_t row = 0;
-	size_t col = 0;
-	size_t row_position = 0;
+// offsets of the first characters of rows, rows end with '\n' or '\v'
+using LineStarts = sp::DynamicArray<uint32_t, sp::MallocAllocator<>>;
 
-	for (size_t i=0; i!=position; ++i){
-		++col;
-		if (text[i]=='\n' || text[i]=='\v'){
-			row_position += col;
-			++row;
-			col = 0;
+LineStarts make_line_starts(const char *text) noexcept{
+	LineStarts starts;
+	sp::push_value(starts, (uint32_t)0);
+	for (const char *it=find_row_end(text); *it!='\0'; it=find_row_end(it)){
+		++it;
+		sp::push_value(starts, (uint32_t)(it - text));
+	}
+	return starts;
+}
+
+struct TextPosition{
+	uint32_t row;
+	uint32_t column;
+};
+
+TextPosition find_text_position(const LineStarts &starts, uint32_t position) noexcept{
+	const uint32_t *first = sp::beg(starts);
+	size_t count = sp::len(starts);
+	while (count > 1){ // last row that starts at or before the position
+		size_t half = count / 2;
+		if (first[half] <= position){
+			first += half;
+			count -= half;
+		} else{
+			count = half;
 		}
 	}
+	return TextPosition{(uint32_t)(first - sp::beg(starts)), position - *first};
+}
+
+// line starts of the code_text are built on the first lookup
+LineStarts code_lines;
+const char *code_lines_text = nullptr;
+
+const LineStarts &get_code_lines() noexcept{
+	if (code_lines_text != code_text){
+		sp::deinit(code_lines);
+		if (code_text) code_lines = make_line_starts(code_text);
+		code_lines_text = code_text;
+	}
+	return code_lines;
+}
+
+void print_codeline(const char *text, const LineStarts &lines, size_t position) noexcept{
+	if (!text){ // text is not avalible when it was tokenized in chunks
+		printf(" -> position: %lu\n\n", position);
+		return;
+	}
+	TextPosition text_pos = find_text_position(lines, position);
+	size_t row = text_pos.row;
+	size_t col = text_pos.column;
+	size_t row_position = position - col;
+
 	printf(" -> row: %lu, column: %lu\n", row, col);
 
 	putchar('>');
@@ -340,16 +788,53 @@ void print_codeline(const char *text, size_t position) noexcept{
 }
 
 
-void raise_error(const char *msg, uint32_t pos) noexcept{
-	fprintf(stderr, "error: \"%s\"", msg);
-	print_codeline(code_text, pos);
+// set while the text is tokenized speculatively, errors jump there instead of exiting
+thread_local jmp_buf *error_jump = nullptr;
+
+struct Diagnostic{
+	ErrorId id;
+	uint32_t pos;
+};
+
+// buffer for errors that are collected instead of being printed,
+// count keeps growing after the buffer is full, so it is the number of all errors
+struct DiagnosticSink{
+	Diagnostic *ptr;
+	uint32_t capacity;
+	uint32_t count = 0;
+};
+
+// when it is set errors are only stored, the tokenizer and the parsers recover from them
+thread_local DiagnosticSink *diagnostics = nullptr;
+
+void raise_error(ErrorId id, uint32_t pos) noexcept{
+	if (error_jump) longjmp(*error_jump, 1);
+	if (diagnostics){
+		if (diagnostics->count < diagnostics->capacity)
+			diagnostics->ptr[diagnostics->count] = Diagnostic{id, pos};
+		++diagnostics->count;
+		return;
+	}
+	fprintf(stderr, "error: \"%s\"", ErrorMessage[(size_t)id]);
+	print_codeline(code_text, get_code_lines(), pos);
 	exit(1);
 }
 
-void raise_error(const char *msg0, const char *msg1, uint32_t pos) noexcept{
-	fprintf(stderr, "error: \"%s%s\"", msg0, msg1);
-	print_codeline(code_text, pos);
-	exit(1);
+// tokenizer runs ahead of the parsers, so diagnostics are sorted by their positions first
+void print_diagnostics(DiagnosticSink &sink) noexcept{
+	uint32_t count = sink.count < sink.capacity ? sink.count : sink.capacity;
+	for (uint32_t i=1; i<count; ++i){
+		Diagnostic diagnostic = sink.ptr[i];
+		uint32_t j = i;
+		for (; j && sink.ptr[j-1].pos>diagnostic.pos; --j) sink.ptr[j] = sink.ptr[j-1];
+		sink.ptr[j] = diagnostic;
+	}
+	for (uint32_t i=0; i!=count; ++i){
+		fprintf(stderr, "error: \"%s\"", ErrorMessage[(size_t)sink.ptr[i].id]);
+		print_codeline(code_text, get_code_lines(), sink.ptr[i].pos);
+		fflush(stdout); // the code line goes to stdout, it has to come before the next message
+	}
+	if (count != sink.count) fprintf(stderr, "%u more errors\n", sink.count-count);
 }
 
 
@@ -367,18 +852,207 @@ void raise_error(const char *msg0, const char *msg1, uint32_t pos) noexcept{
 
 
 
-// array that stores names
-sp::DynamicArray<char, sp::MallocAllocator<>> names;
+// array that stores names, name tables are separate for every thread,
+// so parts of the text can be tokenized in parallel
+thread_local sp::DynamicArray<char, sp::MallocAllocator<>> names;
 
 
-sp::DynamicArray<Node, sp::MallocAllocator<>> make_tokens(const char *input) noexcept{
+
+// INTERNED NAMES
+// every distinct name is stored in names only once, name tokens hold the id of the symbol
+struct Symbol{
+	uint32_t offset; // position of the text inside names
+	uint32_t len;
+	uint32_t hash;
+};
+
+thread_local sp::DynamicArray<Symbol, sp::MallocAllocator<>> symbols;
+thread_local sp::DynamicArray<uint32_t, sp::MallocAllocator<>> symbol_slots; // symbol id + 1, 0 means empty
+
+SP_CSI uint32_t hash_name(const char *text, size_t len) noexcept{
+	uint64_t hash = len * 0x9e3779b97f4a7c15;
+	for (; len>=8; text+=8, len-=8){
+		uint64_t word;
+		__builtin_memcpy(&word, text, 8);
+		hash = (hash ^ word) * 0xff51afd7ed558ccd;
+		hash ^= hash >> 32;
+	}
+	if (len){
+		uint64_t word = 0;
+		__builtin_memcpy(&word, text, len);
+		hash = (hash ^ word) * 0xff51afd7ed558ccd;
+		hash ^= hash >> 32;
+	}
+	return (uint32_t)hash;
+}
+
+sp::Range<const char> symbol_name(uint32_t id) noexcept{
+	return sp::Range<const char>{sp::beg(names) + symbols[id].offset, symbols[id].len};
+}
+
+// slots are rebuilt from the symbols, so they can be cleared when the symbols are replaced
+void grow_symbol_slots() noexcept{
+	size_t slot_count = 1024;
+	while (slot_count <= 2*sp::len(symbols)) slot_count *= 2;
+	sp::resize(symbol_slots, slot_count);
+	for (size_t i=0; i!=slot_count; ++i) symbol_slots[i] = 0;
+
+	size_t mask = slot_count - 1;
+	for (uint32_t id=0; id!=sp::len(symbols); ++id){
+		size_t i = symbols[id].hash & mask;
+		while (symbol_slots[i]) i = (i + 1) & mask;
+		symbol_slots[i] = id + 1;
+	}
+}
+
+uint32_t intern_name(sp::Range<const char> text, uint32_t hash) noexcept{
+	[[unlikely]] if (2*sp::len(symbols) >= sp::len(symbol_slots)) grow_symbol_slots();
+
+	size_t mask = sp::len(symbol_slots) - 1;
+	for (size_t i=hash&mask;; i=(i+1)&mask){
+		uint32_t slot = symbol_slots[i];
+		if (!slot){
+			uint32_t id = sp::len(symbols);
+			sp::push_value(symbols, Symbol{(uint32_t)sp::len(names), (uint32_t)text.size, hash});
+			push_range(names, text);
+			symbol_slots[i] = id + 1;
+			return id;
+		}
+		const Symbol &symbol = symbols[slot-1];
+		if (
+			symbol.hash == hash && symbol.len == text.size
+			&& !__builtin_memcmp(sp::beg(names)+symbol.offset, text.ptr, text.size)
+		) return slot - 1;
+	}
+}
+
+
+// STRING LITERALS
+// data.u32_array of a string token holds the offset and the length of its text, u16 tells where
+// the text is stored, offsets into the source are relative to the token, so they stay valid
+// when positions of tokens are shifted
+enum StringStorage : uint16_t{
+	StringInNames, // offset is the index inside names
+	StringInText,  // text starts at pos + offset inside the source text
+};
+
+inline sp::Range<const char> string_text(const Node &token, const char *text) noexcept{
+	const uint32_t *data = token.data.u32_array;
+	if (token.u16 == StringInText) return sp::Range<const char>{text + token.pos + data[0], data[1]};
+	return sp::Range<const char>{sp::beg(names) + data[0], data[1]};
+}
+
+
+// value of the scope that was already turned from an open brace to an open scope
+constexpr uint32_t ResolvedScope = UINT32_MAX;
+
+// features of the tokenizer chosen at compile time, code of the disabled ones is not generated
+struct TokenizerOptions{
+	bool comments = false;    // comments become Comment tokens, data.size holds their length
+	bool line_starts = false; // starts of rows are added to TokenizerState::line_starts
+	bool intern_names = true; // otherwise data.index of a name is its offset inside the text
+	bool utf8_names = false;  // bytes above 127 are allowed inside names
+	bool positions = true;    // otherwise pos of tokens is 0, errors still report positions
+	bool source_strings = true; // strings without escapes refer to the text, it needs positions
+};
+
+// current token of a tokenizer that has not lexed anything yet
+inline Node null_token() noexcept{
+	Node node{NodeType::Null, 0};
+	node.u16 = 0;
+	node.data.u64 = 0;
+	return node;
+}
+
+// state of the tokenizer that is kept between calls of lex_tokens
+struct TokenizerState{
 	sp::DynamicArray<Node, sp::MallocAllocator<>> tokens;
-	sp::FiniteArray<uint32_t, 32> scopes;
-	Node curr;
-	curr.pos = 0;
+	sp::FiniteArray<uint32_t, 32> scopes; // indices of unresolved open braces inside tokens
+	Node curr = null_token();
 	bool bracket_expression = false;
+	bool finished = false; // set after the '\0' was reached and the Null token was added
+
+	// braces opened before the start of the text, for every one that was closed it is stored
+	// whether a semicolon appeared in it before, semicolons after the last one set outer_terminated
+	sp::DynamicArray<bool, sp::MallocAllocator<>> outer_closes;
+	bool outer_terminated = false;
+
+	LineStarts line_starts; // filled only with the line_starts option
+};
+
+
+namespace priv__{
+
+SP_CSI bool is_name_byte(char c) noexcept{ return (uint8_t)c >= 0x80; }
+
+// adds starts of the rows that begin inside the lexed part of the text
+inline void add_line_starts(LineStarts &starts, const char *begin, const char *end, uint32_t pos) noexcept{
+	for (const char *it=begin; it!=end; ++it)
+		if (*it=='\n' || *it=='\v') sp::push_value(starts, pos + (uint32_t)(it+1-begin));
+}
+
+// appends the text to names without invalid UTF-8 sequences, every one of them is reported
+inline void push_valid_utf8(const char *begin, const char *end, uint32_t pos) noexcept{
+	if (begin == end) return;
+	for (const char *bad; (bad=find_invalid_utf8(begin, end))!=end;){
+		raise_error(ErrorId::InvalidUtf8, pos);
+		sp::push_range(names, sp::Range<const char>{begin, bad-begin});
+		for (begin=bad+1; begin!=end && ((uint8_t)*begin & 0xc0)==0x80; ++begin);
+	}
+	sp::push_range(names, sp::Range<const char>{begin, end-begin});
+}
+
+} // END OF NAMESPACE priv__
+
+// lexes tokens until the end of the text, if Bounded is set it also stops before the first token
+// that starts at or after the limit, returns position where it stopped
+// without positions, positions are computed from the start of the call only where they are needed
+template<bool Bounded, TokenizerOptions Options = TokenizerOptions{}>
+const char *lex_tokens(TokenizerState &state, const char *input, const char *limit) noexcept{
+	sp::DynamicArray<Node, sp::MallocAllocator<>> &tokens = state.tokens;
+	sp::FiniteArray<uint32_t, 32> &scopes = state.scopes;
+	Node curr = state.curr;
+	bool bracket_expression = state.bracket_expression;
+	const char *const first_input = input;
+	const uint32_t first_pos = curr.pos;
+	if constexpr (!Options.positions) curr.pos = 0;
 	for (;;){
+		if constexpr (Bounded){
+			if (input >= limit){
+				state.curr = curr;
+				if constexpr (!Options.positions) state.curr.pos = first_pos + (uint32_t)(input-first_input);
+				state.bracket_expression = bracket_expression;
+				return input;
+			}
+		}
 		const char *prevInput = input;
+		uint32_t token_pos = Options.positions ? curr.pos : first_pos + (uint32_t)(prevInput-first_input);
+		if (is_valid_first_name_char(*input) || (Options.utf8_names && priv__::is_name_byte(*input))){
+			input = find_name_end(input+1);
+			if constexpr (Options.utf8_names){
+				bool ascii = !priv__::is_name_byte(*prevInput);
+				for (; priv__::is_name_byte(*input); input=find_name_end(input+1)) ascii = false;
+				[[unlikely]] if (!ascii && find_invalid_utf8(prevInput, input)!=input)
+					raise_error(ErrorId::InvalidUtf8, token_pos);
+			}
+			sp::Range<const char> text{prevInput, input-prevInput};
+			if (sp::len(text) > UINT16_MAX) raise_error(ErrorId::NameTooLong, token_pos);
+	
+			uint32_t keyword = find_keyword(KeywordTable, text);
+			if (keyword != KeywordHashTable::Empty){
+				curr.type = (NodeType)keyword;
+				goto AddToken;
+			}
+
+			curr.type = NodeType::Name;
+			curr.u16 = sp::len(text);
+			if constexpr (Options.intern_names)
+				curr.data.index = intern_name(text, hash_name(text.ptr, text.size));
+			else
+				curr.data.index = token_pos;
+
+			goto AddToken;
+		}
 		switch (*input){
 		case '=': ++input;
 			if (*input == '='){
@@ -386,12 +1060,10 @@ sp::DynamicArray<Node, sp::MallocAllocator<>> make_tokens(const char *input) noe
 				++input;
 				goto AddToken;
 			}
-			if (!is_whitespace(*(input-2))){
-				NodeType prev = sp::back(tokens).type;
-				if (NodeType::Add<=prev && prev<=NodeType::ArrayRightShift){
-					sp::back(tokens).type = (NodeType)(
-						(uint16_t)prev + ((uint16_t)NodeType::AddAssign-(uint16_t)NodeType::Add)
-					);
+			if (!sp::is_empty(tokens) && !is_whitespace(*(input-2))){ // a previous token starts before it
+				NodeType assign = operator_info(sp::back(tokens).type).assign;
+				if (assign != NodeType::Null){
+					sp::back(tokens).type = assign;
 					goto Break;
 				}
 			}
@@ -404,7 +1076,7 @@ sp::DynamicArray<Node, sp::MallocAllocator<>> make_tokens(const char *input) noe
 				curr.type = NodeType::CarryAdd;
 				++input;
 			} else if (is_number(*input)){
-				curr = get_number_token_from_iterator(&input, curr.pos);
+				curr = get_number_token_from_iterator(&input, token_pos);
 			} else{
 				curr.type = NodeType::Add;
 			}
@@ -419,7 +1091,7 @@ sp::DynamicArray<Node, sp::MallocAllocator<>> make_tokens(const char *input) noe
 				curr.type = NodeType::BorrowSubtract;
 				++input;
 			} else if (is_number(*input)){
-				curr = get_number_token_from_iterator(&input, curr.pos);
+				curr = get_number_token_from_iterator(&input, token_pos);
 				switch (curr.type){
 				case NodeType::Double:
 					curr.data.f64 = -curr.data.f64;
@@ -448,14 +1120,14 @@ sp::DynamicArray<Node, sp::MallocAllocator<>> make_tokens(const char *input) noe
 
 		case '/': ++input;
 			if (*input == '/'){
-				++input;
-				while (*input && *input!='\n') ++input;
-				break;
+				input = find_line_end(input+1);
+				goto Comment;
 			}
 			if (*input == '*'){
 				++input;
 				size_t depth = 1;
 				for (;;){
+					input = find_comment_char(input);
 					if (*input == '\0') break;
 					if (input[0]=='*' && input[1]=='/'){
 						--depth;
@@ -470,7 +1142,7 @@ sp::DynamicArray<Node, sp::MallocAllocator<>> make_tokens(const char *input) noe
 					}
 					++input;
 				}
-				break;
+				goto Comment;
 			}
 			if (*input == '%'){
 				curr.type = NodeType::ModuloDivide;
@@ -531,7 +1203,7 @@ sp::DynamicArray<Node, sp::MallocAllocator<>> make_tokens(const char *input) noe
 				++input;
 			} else if (*input == '<'){
 				++input;
-				if (input[1] == '='){
+				if (*input == '='){
 					curr.type = NodeType::LeftShiftAssign;
 					++input;
 				} else
@@ -549,7 +1221,7 @@ sp::DynamicArray<Node, sp::MallocAllocator<>> make_tokens(const char *input) noe
 				++input;
 			} else if (*input == '>'){
 				++input;
-				if (input[1] == '='){
+				if (*input == '='){
 					curr.type = NodeType::RightShiftAssign;
 					++input;
 				} else
@@ -597,8 +1269,12 @@ sp::DynamicArray<Node, sp::MallocAllocator<>> make_tokens(const char *input) noe
 		
 		
 		case '}':
-			// [[unlikely]] if (sp::is_empty(scopes)) raise_error("too many closing braces", curr.pos);
-			sp::pop(scopes);
+			[[unlikely]] if (sp::is_empty(scopes)){
+				sp::push_value(state.outer_closes, state.outer_terminated);
+				state.outer_terminated = false;
+			} else{
+				sp::pop(scopes);
+			}
 			curr.type = NodeType::CloseBrace;
 			++input;
 			goto AddToken;
@@ -628,14 +1304,14 @@ sp::DynamicArray<Node, sp::MallocAllocator<>> make_tokens(const char *input) noe
 				if (
 					bracket_expression
 					&& !is_whitespace(*(input-2))
+					&& sp::len(tokens) >= 2 // a comment can be between the open bracket and it
 					&& tokens[sp::len(tokens)-2].type==NodeType::OpenBracket
 				){
 					NodeType op = sp::back(tokens).type;
-					if (NodeType::Add<=op && op<=NodeType::RightShift){
+					NodeType array = operator_info(op).array;
+					if (array != NodeType::Null){
 						sp::pop(tokens);
-						sp::back(tokens).type = (NodeType)(
-							(uint16_t)op + ((uint16_t)NodeType::ArrayAdd-(uint16_t)NodeType::Add)
-						);
+						sp::back(tokens).type = array;
 						goto Break;
 					} else if (op == NodeType::ViewPointer){
 						sp::pop(tokens);
@@ -703,7 +1379,7 @@ sp::DynamicArray<Node, sp::MallocAllocator<>> make_tokens(const char *input) noe
 				curr.type = NodeType::GetField;
 			} else if (is_number(*input)){
 				--input;
-				curr = get_number_token_from_iterator(&input, curr.pos);
+				curr = get_number_token_from_iterator(&input, token_pos);
 			} else{
 				curr.type = NodeType::Access;
 			}
@@ -711,7 +1387,12 @@ sp::DynamicArray<Node, sp::MallocAllocator<>> make_tokens(const char *input) noe
 
 
 		case ';':
-			if (!sp::is_empty(scopes)) tokens[(size_t)sp::back(scopes)].type = NodeType::OpenScope;
+			if (sp::is_empty(scopes)){
+				state.outer_terminated = true;
+			} else if (sp::back(scopes) != ResolvedScope){
+				tokens[(size_t)sp::back(scopes)].type = NodeType::OpenScope;
+				sp::back(scopes) = ResolvedScope;
+			}
 			++input;
 			curr.type = NodeType::Terminator;
 			goto AddToken;
@@ -726,7 +1407,6 @@ sp::DynamicArray<Node, sp::MallocAllocator<>> make_tokens(const char *input) noe
 					input = input_backup;
 					goto AddToken;
 				}
-	// TO DO: add utf-8 support
 				curr.type = NodeType::Character;
 				curr.data.u64 = (uint32_t)c;
 
@@ -734,78 +1414,168 @@ sp::DynamicArray<Node, sp::MallocAllocator<>> make_tokens(const char *input) noe
 				goto AddToken;
 			}
 		
-	// TO DO: add raw string literals
-	// TO DO: add utf-8 support
+		// strings without escapes and invalid characters are not copied,
+		// others are copied to names in runs of bytes that are validated at once
 		case '\"':{
 			++input;
 			curr.type = NodeType::String;
-			curr.data.index = sp::len(names);
-			curr.u16 = 0;
-			for (; *input!='\"'; ++curr.u16){
-				if (*input == '\0') raise_error("unfinished string literal", curr.pos);
-
+			const char *run = input;
+			input = find_string_char(input);
+			if constexpr (Options.source_strings && Options.positions){
+				if (*input=='\"' && find_invalid_utf8(run, input)==input){
+					curr.u16 = StringInText;
+					curr.data.u32_array[0] = 1;
+					curr.data.u32_array[1] = input - run;
+					++input;
+					goto AddToken;
+				}
+			}
+			curr.u16 = StringInNames;
+			curr.data.u32_array[0] = sp::len(names);
+			for (;;){
+				priv__::push_valid_utf8(run, input, token_pos);
+				if (*input == '\"'){
+					++input;
+					break;
+				}
+				[[unlikely]] if (*input == '\0'){
+					raise_error(ErrorId::UnfinishedString, token_pos);
+					break;
+				}
 				uint32_t c = get_char_from_iterator(&input);
-				if (c == (uint32_t)-1) raise_error("invalid character at string literal", curr.pos);
-				if (c == (uint32_t)-2) continue;
-				push_value(names, (char)c);
+				if (c == (uint32_t)-1) // the character is skipped
+					raise_error(ErrorId::InvalidStringCharacter, token_pos);
+				else if (c != (uint32_t)-2)
+					push_utf8(names, c);
+				run = input;
+				input = find_string_char(input);
 			}
-			++input;
+			curr.data.u32_array[1] = sp::len(names) - curr.data.u32_array[0];
 			goto AddToken;
 		}
 
+		// raw string literals are enclosed in '"' with the same number of '#' on both sides,
+		// like #"text"# or ##"text"##, their text is taken as it is
 		case '#':{
 			++input;
+			const char *hashes = input;
+			while (*input == '#') ++input;
+			if (*input == '\"'){
+				size_t hash_count = input - hashes + 1;
+				const char *content = ++input;
+				for (;; ++input){
+					input = find_quote(input);
+					[[unlikely]] if (*input == '\0'){
+						raise_error(ErrorId::UnfinishedString, token_pos);
+						break;
+					}
+					size_t count = 0;
+					while (count!=hash_count && input[1+count]=='#') ++count;
+					if (count == hash_count) break;
+				}
+				const char *content_end = input;
+				if (*input) input += 1 + hash_count;
+
+				curr.type = NodeType::String;
+				if constexpr (Options.source_strings && Options.positions){
+					if (find_invalid_utf8(content, content_end) == content_end){
+						curr.u16 = StringInText;
+						curr.data.u32_array[0] = content - prevInput;
+						curr.data.u32_array[1] = content_end - content;
+						goto AddToken;
+					}
+				}
+				curr.u16 = StringInNames;
+				curr.data.u32_array[0] = sp::len(names);
+				priv__::push_valid_utf8(content, content_end, token_pos);
+				curr.data.u32_array[1] = sp::len(names) - curr.data.u32_array[0];
+				goto AddToken;
+			}
+			input = hashes;
+
 			const char *start = input;
-			for (; is_valid_name_char(*input); ++input);
+			input = find_name_end(input);
 			sp::Range<const char> text{start, input-start};
 
-			for (uint32_t i=0; i<(uint32_t)NodeType::Proc; ++i)
-				if (text == KeywordName[i]){
-					curr.type = (NodeType)i;
-					goto AddToken;
-				}
-			raise_error("wrong compile time directive", curr.pos);
+			uint32_t directive = find_keyword(DirectiveTable, text);
+			[[unlikely]] if (directive == KeywordHashTable::Empty){
+				raise_error(ErrorId::WrongDirective, token_pos);
+				goto Break;
+			}
+			curr.type = (NodeType)directive;
+			goto AddToken;
 		}
 		
 		case ' ':
 		case '\t':
 		case '\n':
 			++input;
+			if (is_blank(*input)) input = skip_blanks(input);
 			goto Break;
 
 
 		default:
-			if (is_valid_first_name_char(*input)){
-				const char *start = input;
-				while (is_valid_name_char(*++input));
-				sp::Range<const char> text{start, input-start};
-				if (sp::len(text) > UINT16_MAX) raise_error("name is too long", curr.pos);
-		
-				for (uint32_t i=(uint32_t )NodeType::Proc; i<=(uint32_t)NodeType::Exists; ++i)
-					if (text == KeywordName[(size_t)i]){
-						curr.type = (NodeType)i;
-						goto AddToken;
-					}
-
-				curr.type = NodeType::Name;
-				curr.u16 = sp::len(text);
-				curr.data.index = sp::len(names);
-				push_range(names, text);
-
-				goto AddToken;
-			}
 			if (is_number(*input)){
-				curr = get_number_token_from_iterator(&input, curr.pos);
+				curr = get_number_token_from_iterator(&input, token_pos);
 				goto AddToken;
 			}
 			curr.type = NodeType::Null;
 			push_value(tokens, curr);
-			return tokens;
+			state.curr = curr;
+			if constexpr (!Options.positions) state.curr.pos = first_pos + (uint32_t)(input-first_input);
+			state.bracket_expression = bracket_expression;
+			state.finished = true;
+			return input;
 		}
 	AddToken:
+		if constexpr (!Options.positions) curr.pos = 0; // number tokens are created with their positions
 		push_value(tokens, curr);
 	Break:
-		curr.pos += input - prevInput;
+		if constexpr (Options.line_starts)
+			priv__::add_line_starts(state.line_starts, prevInput, input, token_pos);
+		if constexpr (Options.positions) curr.pos += input - prevInput;
+		continue;
+	Comment:
+		if constexpr (!Options.comments) goto Break;
+		curr.type = NodeType::Comment;
+		curr.data.size = input - prevInput;
+		goto AddToken;
+	}
+}
+
+// number of tokens from the front that will not be changed by the lexer anymore, the last tokens
+// can still be merged with the next ones and open braces can still become open scopes
+size_t final_token_count(const TokenizerState &state) noexcept{
+	size_t count = sp::len(state.tokens);
+	if (state.finished) return count;
+	count = count > 2 ? count-2 : 0;
+	for (size_t i=0; i!=sp::len(state.scopes); ++i)
+		if (state.scopes.data[i] != ResolvedScope && state.scopes.data[i] < count) count = state.scopes.data[i];
+	return count;
+}
+
+// removes tokens from the front, they must be final
+void drop_tokens(TokenizerState &state, size_t count) noexcept{
+	Node *tokens = sp::beg(state.tokens);
+	memmove(tokens, tokens+count, (sp::len(state.tokens)-count)*sizeof(Node));
+	sp::shrink_back(state.tokens, count);
+	for (size_t i=0; i!=sp::len(state.scopes); ++i)
+		if (state.scopes[i] != ResolvedScope) state.scopes[i] -= count;
+}
+
+// with the line_starts option the collected rows replace the cached line starts of the code_text,
+// so they are not built again when the errors of the text are printed
+template<TokenizerOptions Options = TokenizerOptions{}>
+sp::DynamicArray<Node, sp::MallocAllocator<>> make_tokens(const char *input) noexcept{
+	TokenizerState state;
+	if constexpr (Options.line_starts) sp::push_value(state.line_starts, (uint32_t)0);
+	lex_tokens<false, Options>(state, input, nullptr);
+	sp::deinit(state.outer_closes);
+	if constexpr (Options.line_starts){
+		sp::deinit(code_lines);
+		code_lines = state.line_starts;
+		code_lines_text = input;
 	}
+	return state.tokens;
 }
 
@@ -0,0 +1,6 @@
+#!/bin/bash
+
+g++ check_parallel_tokens.cpp -o check_parallel_tokens -g -std=c++20 -Iinclude -fno-exceptions -pthread
+g++ check_token_update.cpp -o check_token_update -g -std=c++20 -Iinclude -fno-exceptions
+g++ check_constant_folding.cpp -o check_constant_folding -g -std=c++20 -Iinclude -fno-exceptions
+g++ compare_engines.cpp -o compare_engines -O2 -std=c++20 -Iinclude -fno-exceptions
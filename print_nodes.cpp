@@ -1,40 +1,100 @@
 #include "main_parser.hpp"
+#include "parse_cache.hpp"
+#include "source_loader.hpp"
+#include "token_cursor.hpp"
 
+// both engines give the same output, the other one can be chosen to compare them
+#ifndef PRINT_NODES_ENGINE
+#define PRINT_NODES_ENGINE PrecedenceStack
+#endif
 
 
 
 
+
+void print_symbol(uint32_t id) noexcept{
+	sp::Range<const char> name = symbol_name(id);
+	fwrite(name.ptr, 1, name.size, stdout);
+}
+
+void print_string(const Node &node) noexcept{
+	sp::Range<const char> text = string_text(node, code_text);
+	fwrite(text.ptr, 1, text.size, stdout);
+}
+
+
+
 int main(int argc, char **argv){
-	sp::DynamicArray<char, sp::MallocAllocator<>> text;
-	
-	FILE *file = stdin;
-	if (argc == 2){
-		file = fopen(argv[1], "r");
-		if (!file){
+	SourceText text;
+	// the optional second argument is a directory for cached results
+	if (argc==2 || argc==3){
+		text = load_source(argv[1]);
+		if (!text.ptr){
 			fputs("file not found\n", stderr);
 			return 1;
 		}
+	} else{
+		text = load_source(STDIN_FILENO);
+		if (!text.ptr){
+			fputs("cannot read the standard input\n", stderr);
+			return 1;
+		}
 	}
 
-	// read text
-	for (;;){
-		int c = getc(file);
-		if (c == EOF) break;
-		sp::push_value(text, (char)c);
-	}
-	sp::push_value(text, '\0');
-
-	code_text = sp::beg(text);
+	code_text = text.ptr;
 
-	auto tokens = make_tokens(sp::beg(text));
-	
+	char cache_path[4096];
+	bool use_cache = false;
+	uint64_t cache_key = 0;
+	ParseCache cache;
+	if (argc == 3){
+		cache_key = parse_cache_key(text.ptr, text.size);
+		use_cache = make_parse_cache_path(cache_path, sizeof(cache_path), argv[2], cache_key);
+	}
 	NodeArrayType nodes;
 	LabelArrayType labels;
+	sp::Range<const Node> output;
+	if (use_cache && load_parse_cache(cache, cache_path, cache_key, text.size)){
+		use_cached_names(cache);
+		output = cache.data.nodes;
+	} else{
+		// all errors are reported at once
+		Diagnostic diagnostic_buffer[64];
+		DiagnosticSink sink{diagnostic_buffer, (uint32_t)sp::len(diagnostic_buffer)};
+		diagnostics = &sink;
+
+		// the whole token array is cached, otherwise tokens are lexed lazily
+		sp::DynamicArray<Node, sp::MallocAllocator<>> tokens;
+		if (use_cache){
+			tokens = make_tokens(text.ptr);
+			const Node *token_iter = sp::beg(tokens);
+			parse_function<ExpressionEngine::PRINT_NODES_ENGINE>(nodes, labels, &token_iter);
+		} else{
+			LazyTokens lazy_tokens = make_lazy_tokens(text.ptr);
+			TokenCursor token_iter = beg(lazy_tokens);
+			parse_function<ExpressionEngine::PRINT_NODES_ENGINE>(nodes, labels, &token_iter);
+		}
+
+		diagnostics = nullptr;
+		if (sink.count){
+			print_diagnostics(sink);
+			return 1;
+		}
 
-	const Node *token_iter = sp::beg(tokens);
-	parse_function(nodes, labels, &token_iter);
+		if (use_cache){
+			ParseCacheData data{};
+			data.tokens = sp::Range<const Node>{sp::beg(tokens), sp::len(tokens)};
+			data.names = sp::Range<const char>{sp::beg(names), sp::len(names)};
+			data.symbols = sp::Range<const Symbol>{sp::beg(symbols), sp::len(symbols)};
+			data.nodes = sp::Range<const Node>{sp::beg(nodes), sp::len(nodes)};
+			data.labels = sp::Range<const LabelInfo>{sp::beg(labels), sp::len(labels)};
+			if (!write_parse_cache(cache_path, cache_key, text.size, data))
+				fputs("cannot write the cache\n", stderr);
+		}
+		output = sp::Range<const Node>{sp::beg(nodes), sp::len(nodes)};
+	}
 
-	for (auto it=sp::beg(nodes); it!=sp::end(nodes); ++it){
+	for (const Node *it=output.ptr; it!=output.ptr+output.size; ++it){
 		printf("%5u :: ", (uint32_t)it->pos);
 		switch (it->type){
 		case NodeType::Set:
@@ -42,7 +102,7 @@ int main(int argc, char **argv){
 			break;
 		case NodeType::Unset:
 			printf("unset constant variable -> ");
-			for (size_t i=it->data.index; i!=it->data.index+it->u16; ++i) putchar(names[i]);
+			print_symbol(it->data.index);
 			break;
 		case NodeType::StaticRun:
 			printf("set constant variable");
@@ -304,11 +364,11 @@ int main(int argc, char **argv){
 			break;
 		case NodeType::Name:
 			printf("identifier name -> ");
-			for (size_t i=it->data.index; i!=it->data.index+it->u16; ++i) putchar(names[i]);
+			print_symbol(it->data.index);
 			break;
 		case NodeType::String:
 			printf("string -> \"");
-			for (size_t i=it->data.index; i!=it->data.index+it->u16; ++i) putchar(names[i]);
+			print_string(*it);
 			putchar('\"');
 			break;
 		case NodeType::Character:
@@ -374,7 +434,7 @@ int main(int argc, char **argv){
 			break;
 		case NodeType::Goto:
 			printf("goto label -> ");
-			for (size_t i=it->data.index; i!=it->data.index+it->u16; ++i) putchar(names[i]);
+			print_symbol(it->data.index);
 			break;
 		case NodeType::GotoInstruction:
 			printf("goto instruction");
@@ -384,14 +444,17 @@ int main(int argc, char **argv){
 			break;
 		case NodeType::BreakIterator:
 			printf("break from named iteration -> ");
-			for (size_t i=it->data.index; i!=it->data.index+it->u16; ++i) putchar(names[i]);
+			print_symbol(it->data.index);
 			break;
 		case NodeType::Continue:
 			printf("continue : %lu", it->data.size);
 			break;
 		case NodeType::ContinueIterator:
 			printf("continue named iteration -> ");
-			for (size_t i=it->data.index; i!=it->data.index+it->u16; ++i) putchar(names[i]);
+			print_symbol(it->data.index);
+			break;
+		case NodeType::SharedSubtree:
+			printf("shared subtree -> %lu", it->data.index);
 			break;
 		default:
 			printf("print is not implemented for this token");